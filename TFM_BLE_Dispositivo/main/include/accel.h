@@ -5,22 +5,15 @@
 #include <stdbool.h>
 
 #define ACCEL_SAMPLING_FREQ 100 /* 100 Hz = 1 muestra cada 10ms */
-#define SAMPLES_PER_PACKET  35 /* Numero de muestras por paquete */
 
-/* Estructura de una muestra (X, Y, Z) */
-typedef struct {
-    int16_t x;
-    int16_t y;
-    int16_t z;
-} accel_raw_t;
+/* Formato del paquete BLE (structs y constantes generados desde protocol/accel_packet.json) */
+#include "accel_packet.h"
 
-/* Estructura del paquete a enviar por Bluetooth*/
-/* __attribute__((packed)) evita huecos en memoria para que Python lo lea bien */
-typedef struct __attribute__((packed)) {
-    uint32_t sequence_id; /* Contador para detectar paquetes perdidos */
-    uint32_t timestamp_start; /* Tiempo (ms) de la PRIMERA muestra del array */
-    accel_raw_t samples[SAMPLES_PER_PACKET]; 
-} accel_packet_t;
+#define ACCEL_FULL_SCALE ACCEL_RANGE_2G /* Fondo de escala configurado */
+
+/* Bytes a enviar de un paquete con "n" muestras (solo se envian las validas) */
+#define ACCEL_PACKET_HEADER_SIZE sizeof(accel_header_t)
+#define ACCEL_PACKET_SIZE(n)     (ACCEL_PACKET_HEADER_SIZE + (n) * sizeof(accel_raw_t))
 
 /* Declaraciones de funciones */
 void accel_init(void);
@@ -29,5 +22,6 @@ bool accel_is_batch_ready(void);   /* ¿Está el buffer lleno? */
 accel_packet_t* accel_get_batch(void); /* Devuelve el paquete listo */
 accel_raw_t accel_get_last_sample(void); /* Leer el ultimo dato */
 void accel_reset_counters(void);
+uint32_t accel_elapsed_ms(void); /* ms desde la suscripción (misma base que timestamp_start) */
 
 #endif 
\ No newline at end of file
@@ -0,0 +1,77 @@
+/* GENERADO AUTOMATICAMENTE por protocol/gen_packet.py a partir de protocol/accel_packet.json. NO EDITAR. */
+#ifndef ACCEL_PACKET_H
+#define ACCEL_PACKET_H
+
+#include <stdint.h>
+
+#define ACCEL_SAMPLES_PER_PACKET 35 /* Numero maximo de muestras por paquete */
+#define ACCEL_FORMAT_VERSION 2 /* Version del formato de paquete (0 = antiguo, sin cabecera; 1 = sin notify_offset_ms) */
+#define ACCEL_ENC_RAW_I16 0 /* Codificacion: int16 little endian, canales intercalados */
+#define ACCEL_CH_X 1 /* Mascara de canales presentes */
+#define ACCEL_CH_Y 2
+#define ACCEL_CH_Z 4
+#define ACCEL_CH_XYZ 7
+#define ACCEL_RANGE_2G 0 /* Fondo de escala: +-2g, 4g, 8g, 16g */
+#define ACCEL_RANGE_4G 1
+#define ACCEL_RANGE_8G 2
+#define ACCEL_RANGE_16G 3
+
+/* Estructura de una muestra (X, Y, Z) */
+typedef struct __attribute__((packed)) {
+    int16_t x;
+    int16_t y;
+    int16_t z;
+} accel_raw_t;
+_Static_assert(sizeof(accel_raw_t) == 6, "accel_raw_t no coincide con el esquema");
+
+#define ACCEL_FORMAT_ENCODING_SHIFT 0
+#define ACCEL_FORMAT_ENCODING_MASK 0x0F
+#define ACCEL_FORMAT_VERSION_SHIFT 4
+#define ACCEL_FORMAT_VERSION_MASK 0x0F
+#define ACCEL_PACK_FORMAT(encoding, version) ((uint8_t)((((encoding) & 0x0F) << 0) | (((version) & 0x0F) << 4)))
+
+#define ACCEL_CHANNELS_MASK_SHIFT 0
+#define ACCEL_CHANNELS_MASK_MASK 0x0F
+#define ACCEL_CHANNELS_RANGE_SHIFT 4
+#define ACCEL_CHANNELS_RANGE_MASK 0x0F
+#define ACCEL_PACK_CHANNELS(mask, range) ((uint8_t)((((mask) & 0x0F) << 0) | (((range) & 0x0F) << 4)))
+
+/* Cabecera autodescriptiva del paquete (la Raspi decodifica sin configuracion) */
+typedef struct __attribute__((packed)) {
+    uint8_t format; /* Version (4 bits altos) | codificacion (4 bits bajos) */
+    uint8_t channels; /* Fondo de escala (4 bits altos) | mascara de canales (4 bits bajos) */
+    uint16_t sample_rate_hz; /* Frecuencia de muestreo con la que se tomo el paquete */
+    uint8_t sample_count; /* Muestras validas en "samples" */
+    uint32_t sequence_id; /* Contador para detectar paquetes perdidos */
+    uint32_t timestamp_start; /* Tiempo (ms) de la PRIMERA muestra del array */
+    uint16_t notify_offset_ms; /* Tiempo (ms) desde timestamp_start hasta entregar el paquete a NimBLE (satura en 65535) */
+} accel_header_t;
+_Static_assert(sizeof(accel_header_t) == 15, "accel_header_t no coincide con el esquema");
+
+/* Estructura del paquete a enviar por Bluetooth (solo se envian las muestras validas) */
+typedef struct __attribute__((packed)) {
+    accel_header_t header;
+    accel_raw_t samples[ACCEL_SAMPLES_PER_PACKET];
+} accel_packet_t;
+_Static_assert(sizeof(accel_packet_t) == 225, "accel_packet_t no coincide con el esquema");
+
+/* Cabecera de la version 1 (sin notify_offset_ms). Solo para decodificar */
+typedef struct __attribute__((packed)) {
+    uint8_t format;
+    uint8_t channels;
+    uint16_t sample_rate_hz;
+    uint8_t sample_count;
+    uint32_t sequence_id;
+    uint32_t timestamp_start;
+} accel_header_v1_t;
+_Static_assert(sizeof(accel_header_v1_t) == 13, "accel_header_v1_t no coincide con el esquema");
+
+/* Paquete del firmware antiguo (version 0, sin cabecera de formato). Solo para decodificar */
+typedef struct __attribute__((packed)) {
+    uint32_t sequence_id;
+    uint32_t timestamp_start;
+    accel_raw_t samples[35];
+} accel_packet_v0_t;
+_Static_assert(sizeof(accel_packet_v0_t) == 218, "accel_packet_v0_t no coincide con el esquema");
+
+#endif // ACCEL_PACKET_H
@@ -18,6 +18,7 @@
 /* FreeRTOS APIs */
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/semphr.h>
 
 /* NimBLE stack APIs */
 #include "host/ble_hs.h"
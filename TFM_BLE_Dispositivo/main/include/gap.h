@@ -5,6 +5,11 @@
 #include "host/ble_gap.h"
 #include "services/gap/ble_svc_gap.h"
 
+/* Anuncio: UUID del servicio del acelerómetro + datos de servicio [flags, versión de paquete]
+   para que la Raspi filtre sin conectar ni depender del nombre */
+#define ADV_SVC_UUID16 0x00FF /* Mismo UUID que el servicio GATT del acelerómetro */
+#define ADV_FLAG_LOCKED 0x01 /* Sesión cerrada: solo acepta a la Raspi que se conectó primero */
+
 /* Declaraciones de las funciones */
 void adv_init(void);
 int gap_init(void);
@@ -5,6 +5,9 @@
 #include "services/gatt/ble_svc_gatt.h"
 #include "host/ble_gap.h"
 
+/* Control de flujo por créditos */
+#define ACCEL_HOLDBACK_PACKETS 16 /* Paquetes retenidos como máximo mientras no hay créditos */
+
 /* Declaraciones de las funciones */
 void gatt_svr_subscribe_cb(struct ble_gap_event *event);
 int gatt_svc_init(void);
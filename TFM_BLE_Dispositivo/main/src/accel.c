@@ -43,8 +43,13 @@ void accel_sample_and_store(void) {
         current_time = esp_timer_get_time();
         relative_time = current_time - start_time_offset;
 
-        acc_buffer.timestamp_start = (uint32_t)(relative_time / 1000); 
-        acc_buffer.sequence_id = global_packet_counter;
+        acc_buffer.header.timestamp_start = (uint32_t)(relative_time / 1000); 
+        acc_buffer.header.sequence_id = global_packet_counter;
+
+        /* Cabecera: describe como esta codificado el paquete */
+        acc_buffer.header.format = ACCEL_PACK_FORMAT(ACCEL_ENC_RAW_I16, ACCEL_FORMAT_VERSION);
+        acc_buffer.header.channels = ACCEL_PACK_CHANNELS(ACCEL_CH_XYZ, ACCEL_FULL_SCALE);
+        acc_buffer.header.sample_rate_hz = ACCEL_SAMPLING_FREQ;
     }
 
     /* Leemos el sensor */
@@ -64,10 +69,11 @@ void accel_sample_and_store(void) {
     last_sample = acc_buffer.samples[sample_count];
 
     sample_count++;
+    acc_buffer.header.sample_count = (uint8_t)sample_count;
 }
 
 bool accel_is_batch_ready(void) {
-    return sample_count >= SAMPLES_PER_PACKET;
+    return sample_count >= ACCEL_SAMPLES_PER_PACKET;
 }
 
 accel_packet_t* accel_get_batch(void) {
@@ -81,4 +87,8 @@ accel_packet_t* accel_get_batch(void) {
 
 accel_raw_t accel_get_last_sample(void) {
     return last_sample;
+}
+
+uint32_t accel_elapsed_ms(void) {
+    return (uint32_t)((esp_timer_get_time() - start_time_offset) / 1000);
 }
\ No newline at end of file
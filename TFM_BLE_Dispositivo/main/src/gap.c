@@ -1,6 +1,7 @@
 #include "gap.h"
 #include "common.h"
 #include "gatt_svc.h"
+#include "accel_packet.h"
 #include "host/ble_hs.h"
 #include "host/util/util.h"
 #include "nimble/ble.h"
@@ -84,6 +85,8 @@ static void start_advertising(void) {
 
     struct ble_hs_adv_fields adv_fields = {0}; 
     struct ble_gap_adv_params adv_params = {0}; 
+    static const ble_uuid16_t adv_uuids[] = {BLE_UUID16_INIT(ADV_SVC_UUID16)}; /* Servicio anunciado */
+    static uint8_t adv_svc_data[4]; /* UUID (LE) + flags + versión del formato de paquete */
 
     /* ---- CONFIGURACIÓN DE CAMPOS DE ANUNCIO (Payload) ---- */
 
@@ -102,7 +105,20 @@ static void start_advertising(void) {
         adv_fields.flags = BLE_HS_ADV_F_DISC_GEN | BLE_HS_ADV_F_BREDR_UNSUP; /* Descubrible con BLE */
     }
 
-    /* Aplicamos los campos */
+    /* Servicio del acelerómetro: la Raspi escanea filtrando por este UUID */
+    adv_fields.uuids16 = adv_uuids;
+    adv_fields.num_uuids16 = 1;
+    adv_fields.uuids16_is_complete = 1;
+
+    /* Datos de servicio: estado del dispositivo (flags) y versión del formato de paquete */
+    adv_svc_data[0] = ADV_SVC_UUID16 & 0xFF;
+    adv_svc_data[1] = ADV_SVC_UUID16 >> 8;
+    adv_svc_data[2] = session_locked ? ADV_FLAG_LOCKED : 0;
+    adv_svc_data[3] = ACCEL_FORMAT_VERSION;
+    adv_fields.svc_data_uuid16 = adv_svc_data;
+    adv_fields.svc_data_uuid16_len = sizeof(adv_svc_data);
+
+    /* Aplicamos los campos (3 flags + 8 nombre + 4 icono + 4 UUID + 6 datos = 25 de 31 bytes) */
     ble_gap_adv_set_fields(&adv_fields);
    
 
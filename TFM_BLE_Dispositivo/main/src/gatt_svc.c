@@ -9,7 +9,18 @@ static uint16_t accel_chr_conn_handle = 0; /* Identificador del cliente (raspi)
 static bool accel_chr_conn_handle_inited = false; /* Indica si "accel_chr_conn_handle" tiene un valor valido */
 static bool accel_notify_status = false; /* Indica si el cliente está suscrito */
 
+/* Control de flujo: la Raspi concede créditos (1 crédito = 1 paquete) según vacía su cola */
+static const ble_uuid16_t credit_chr_uuid = BLE_UUID16_INIT(0xFF02); /* UUID de la característica de créditos */
+static uint16_t credit_chr_val_handle; /* Identificador de la caracteristica de créditos */
+static uint16_t accel_credits = 0; /* Paquetes que aún podemos notificar */
+static accel_packet_t holdback_buf[ACCEL_HOLDBACK_PACKETS]; /* Paquetes retenidos sin créditos */
+static uint16_t holdback_head = 0; /* Posición del paquete retenido más antiguo */
+static uint16_t holdback_count = 0; /* Paquetes retenidos actualmente */
+static uint32_t holdback_dropped = 0; /* Paquetes descartados por buffer lleno */
+static SemaphoreHandle_t credit_mutex; /* Protege créditos y buffer (tarea NimBLE vs tarea acelerómetro) */
+
 static int accel_chr_access(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg);
+static int credit_chr_access(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg);
 
 static const struct ble_gatt_svc_def gatt_svr_svcs[] = { /* Tabla de servicios GATT */
     {
@@ -24,6 +35,13 @@ static const struct ble_gatt_svc_def gatt_svr_svcs[] = { /* Tabla de servicios G
                 .flags = BLE_GATT_CHR_F_READ_ENC | BLE_GATT_CHR_F_NOTIFY,
                 .val_handle = &accel_chr_val_handle /*Identificador de la caracteristica de acelerometro*/
             },
+            {
+                .uuid = &credit_chr_uuid.u, /*UUID de los créditos*/
+                .access_cb = credit_chr_access, /*Callback de escritura de créditos*/
+                /*(Permisos). ENCRIPTADO. La Raspi escribe (con o sin respuesta) los créditos concedidos*/
+                .flags = BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_NO_RSP | BLE_GATT_CHR_F_WRITE_ENC,
+                .val_handle = &credit_chr_val_handle /*Identificador de la caracteristica de créditos*/
+            },
             {
                 0, /*Fin de la lista de características*/
             }
@@ -57,24 +75,124 @@ static int accel_chr_access(uint16_t conn_handle, uint16_t attr_handle,
     return BLE_ATT_ERR_UNLIKELY;
 }
 
+/* Envía un paquete por notificación. Devuelve 0 si NimBLE lo ha aceptado */
+static int notify_packet(accel_packet_t *packet) {
+
+    struct os_mbuf *om;
+    uint32_t waited_ms;
+
+    /* Marca de trazado: cuánto lleva el paquete en el dispositivo (muestreo + retención) */
+    waited_ms = accel_elapsed_ms() - packet->header.timestamp_start;
+    packet->header.notify_offset_ms = (waited_ms > UINT16_MAX) ? UINT16_MAX : (uint16_t)waited_ms;
+
+    /* Empaquetamos en formato NimBLE */
+    om = ble_hs_mbuf_from_flat(packet, ACCEL_PACKET_SIZE(packet->header.sample_count));
+    if (om == NULL) {
+        return BLE_HS_ENOMEM; /* Sin memoria: el paquete se queda retenido */
+    }
+
+    /* Enviamos (NimBLE libera "om" aunque falle) */
+    return ble_gatts_notify_custom(accel_chr_conn_handle, accel_chr_val_handle, om);
+}
+
+/* Vacía el buffer de retención mientras queden créditos. Requiere credit_mutex tomado */
+static void holdback_flush_locked(void) {
+    while (holdback_count > 0 && accel_credits > 0) {
+        if (notify_packet(&holdback_buf[holdback_head]) != 0) {
+            break; /* Se reintentará con el siguiente paquete o con nuevos créditos */
+        }
+        holdback_head = (holdback_head + 1) % ACCEL_HOLDBACK_PACKETS;
+        holdback_count--;
+        accel_credits--;
+    }
+}
+
+/* Retiene una copia del paquete. Si no cabe se descarta el más antiguo. Requiere credit_mutex tomado */
+static void holdback_push_locked(const accel_packet_t *packet) {
+
+    uint16_t tail;
+
+    if (holdback_count == ACCEL_HOLDBACK_PACKETS) {
+        holdback_head = (holdback_head + 1) % ACCEL_HOLDBACK_PACKETS;
+        holdback_count--;
+        holdback_dropped++;
+        ESP_LOGW("GATT", "Sin créditos: paquete descartado (total %lu)", (unsigned long)holdback_dropped);
+    }
+
+    tail = (holdback_head + holdback_count) % ACCEL_HOLDBACK_PACKETS;
+    memcpy(&holdback_buf[tail], packet, sizeof(accel_packet_t));
+    holdback_count++;
+}
+
+/* Reinicia créditos y buffer de retención (nueva suscripción) */
+static void credits_reset(void) {
+    xSemaphoreTake(credit_mutex, portMAX_DELAY);
+    accel_credits = 0;
+    holdback_head = 0;
+    holdback_count = 0;
+    xSemaphoreGive(credit_mutex);
+}
+
+/* Callback de la característica de créditos */
+/*La Raspi escribe un uint16 (little endian) con los créditos que concede*/
+static int credit_chr_access(uint16_t conn_handle, uint16_t attr_handle,
+                             struct ble_gatt_access_ctxt *ctxt, void *arg) {
+
+    uint16_t granted;
+    uint16_t len;
+    int rc;
+
+    if (ctxt->op != BLE_GATT_ACCESS_OP_WRITE_CHR || attr_handle != credit_chr_val_handle) {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+
+    len = OS_MBUF_PKTLEN(ctxt->om);
+    if (len != sizeof(granted)) {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+
+    rc = ble_hs_mbuf_to_flat(ctxt->om, &granted, sizeof(granted), NULL);
+    if (rc != 0) {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+
+    xSemaphoreTake(credit_mutex, portMAX_DELAY);
+    /* Saturamos para que un host con fallos no desborde el contador */
+    accel_credits = (accel_credits > UINT16_MAX - granted) ? UINT16_MAX : accel_credits + granted;
+    /* Primero salen los paquetes retenidos, en orden */
+    if (accel_notify_status && accel_chr_conn_handle_inited) {
+        holdback_flush_locked();
+    }
+    xSemaphoreGive(credit_mutex);
+
+    return 0;
+}
+
 /* ----------------- FUNCIONES PÚBLICAS --------------------- */
 
 /* Función de envío de Bloques */
 void send_accel_batch(void) {
 
     accel_packet_t *batch;
-    struct os_mbuf *om;
 
     if (accel_notify_status && accel_chr_conn_handle_inited) {
         
         /* Obtenemos el paquete lleno */
         batch = accel_get_batch();
 
-        /* Empaquetamos en formato NimBLE */
-        om = ble_hs_mbuf_from_flat(batch, sizeof(accel_packet_t));
+        xSemaphoreTake(credit_mutex, portMAX_DELAY);
 
-        /* Enviamos */
-        ble_gatts_notify_custom(accel_chr_conn_handle, accel_chr_val_handle, om);
+        /* Los retenidos van antes para no desordenar la secuencia */
+        holdback_flush_locked();
+
+        if (holdback_count == 0 && accel_credits > 0 && notify_packet(batch) == 0) {
+            accel_credits--;
+        } else {
+            /* Sin créditos (la Raspi va retrasada): lo guardamos hasta que los conceda */
+            holdback_push_locked(batch);
+        }
+
+        xSemaphoreGive(credit_mutex);
 
     } else {
         /* Si no hay nadie escuchando, vaciamos el buffer igual */
@@ -94,6 +212,9 @@ void gatt_svr_subscribe_cb(struct ble_gap_event *event) {
         if (event->subscribe.cur_notify > 0) {
             accel_reset_counters(); 
         }
+
+        /* Cada suscripción empieza sin créditos: la Raspi concede la ventana inicial */
+        credits_reset();
     }
 }
 
@@ -102,6 +223,9 @@ int gatt_svc_init(void) {
     
     int rc;
 
+    credit_mutex = xSemaphoreCreateMutex(); /*Mutex del control de flujo*/
+    if (credit_mutex == NULL) return BLE_HS_ENOMEM;
+
     ble_svc_gatt_init(); /*Inicializa el servicio GATT (obligatorio por estandar)*/
     rc = ble_gatts_count_cfg(gatt_svr_svcs); /*Contamos los servicios (seguridad)*/
     if (rc != 0) return rc;
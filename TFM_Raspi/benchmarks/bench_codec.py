@@ -0,0 +1,84 @@
+"""Benchmark del códec de sesiones: ratio de compresión y MB/s de codificación/decodificación.
+
+Los datos salen de decode_packet_arrays() sobre paquetes sintéticos con señal de
+caminar, o de una sesión grabada con --session data/raw/<sesión>.
+
+Uso (desde TFM_Raspi/):
+  python -m benchmarks.bench_codec [--packets 20000] [--session data/raw/<sesión>]
+"""
+import argparse
+import io
+import time
+import zlib
+
+import numpy as np
+
+from benchmarks.bench_decode import synthetic_packets
+from modules.codec import BACKEND_LZ4, BACKEND_ZLIB, BACKEND_ZSTD, StreamEncoder, available_backends, iter_blocks
+from modules.data_handler import DeviceClock, decode_packet_arrays, sample_timestamps_us
+from modules.session_store import SessionReader
+
+BACKEND_NAMES = {BACKEND_ZLIB: "zlib-1", BACKEND_LZ4: "lz4", BACKEND_ZSTD: "zstd-3"}
+
+
+# Columnas de una sesión sintética: decodificadas como en el pipeline real
+def synthetic_columns(n_packets):
+    clock = DeviceClock()
+    t0 = time.monotonic_ns()
+    parts = {name: [] for name in ("t", "x", "y", "z", "seq")}
+    for i, data in enumerate(synthetic_packets(n_packets, realistic=True)):
+        packet = decode_packet_arrays(data)
+        jitter = int(np.random.default_rng(i).integers(0, 20_000_000)) # Hasta 20 ms de latencia BLE
+        parts["t"].append(clock.to_host_us(sample_timestamps_us(packet), t0 + i * 350_000_000 + jitter))
+        for axis in ("x", "y", "z"):
+            parts[axis].append(packet[axis])
+        parts["seq"].append(np.full(len(packet["x"]), packet["sequence_id"], dtype=np.uint32))
+    return {name: np.concatenate(values) for name, values in parts.items()}
+
+
+def session_columns(session_dir):
+    reader = SessionReader(session_dir)
+    alias = reader.devices()[0]
+    print(f"Sesión {session_dir}, dispositivo {alias}")
+    return reader.query(alias)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--packets", type=int, default=20000)
+    parser.add_argument("--session", help="Carpeta de una sesión grabada")
+    args = parser.parse_args()
+
+    columns = session_columns(args.session) if args.session else synthetic_columns(args.packets)
+    rows = len(columns["t"])
+    raw = b"".join(np.ascontiguousarray(columns[name]).tobytes() for name in ("t", "x", "y", "z", "seq"))
+    raw_mb = len(raw) / 1e6
+    print(f"{rows} muestras, {raw_mb:.2f} MB en bruto ({len(raw) / rows:.0f} B/muestra)\n")
+
+    # Referencia: compresor genérico directamente sobre las columnas
+    start = time.perf_counter()
+    plain = zlib.compress(raw, 1)
+    elapsed = time.perf_counter() - start
+    print(f"{'zlib-1 sin transformar':<24} ratio {len(raw) / len(plain):6.2f}  cod {raw_mb / elapsed:8.1f} MB/s")
+
+    for backend in available_backends():
+        out = io.BytesIO()
+        start = time.perf_counter()
+        encoder = StreamEncoder(out, backend=backend)
+        encoder.write(columns["t"], columns["x"], columns["y"], columns["z"], columns["seq"])
+        encoder.close()
+        encode_s = time.perf_counter() - start
+
+        out.seek(0)
+        start = time.perf_counter()
+        blocks = list(iter_blocks(out))
+        decode_s = time.perf_counter() - start
+
+        ok = all(np.array_equal(np.concatenate([b[name] for b in blocks]), columns[name]) for name in columns)
+        print(f"{'códec + ' + BACKEND_NAMES[backend]:<24} ratio {encoder.ratio:6.2f}  cod {raw_mb / encode_s:8.1f} MB/s"
+              f"  dec {raw_mb / decode_s:8.1f} MB/s  ({encoder.encoded_bytes / rows:.2f} B/muestra)"
+              f"  {'OK' if ok else 'ERROR: no coincide'}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,72 @@
+"""Benchmark de decodificación: decode_packet (dicts) frente a los decodificadores NumPy.
+
+Uso (desde TFM_Raspi/):
+  python -m benchmarks.bench_decode [--packets 20000]
+"""
+import argparse
+import time
+
+import numpy as np
+
+from modules.data_handler import decode_packet, decode_packet_arrays, decode_packets
+from modules.packet_schema import CH_XYZ, ENC_RAW_I16, FORMAT_VERSION, HEADER_DTYPE, PACKET_DTYPE, \
+    RANGE_2G, SAMPLES_PER_PACKET, BITFIELDS
+from modules.simulator import realistic_signal
+
+
+# Genera paquetes sintéticos de la versión actual (FORMAT_VERSION, hoy la 2) idénticos
+# byte a byte a los del firmware.
+# Con realistic=True las muestras siguen realistic_signal(); si no, son aleatorias.
+def synthetic_packets(n_packets, seed=0, realistic=False):
+    rng = np.random.default_rng(seed)
+    arr = np.zeros(n_packets, dtype=PACKET_DTYPE)
+    header = arr["header"]
+    header["format"] = (FORMAT_VERSION << BITFIELDS["format"]["version"][0]) | ENC_RAW_I16
+    header["channels"] = (RANGE_2G << BITFIELDS["channels"]["range"][0]) | CH_XYZ
+    header["sample_rate_hz"] = 100
+    header["sample_count"] = SAMPLES_PER_PACKET
+    header["sequence_id"] = np.arange(n_packets)
+    header["timestamp_start"] = np.arange(n_packets) * SAMPLES_PER_PACKET * 10
+    if realistic:
+        signal = realistic_signal(n_packets * SAMPLES_PER_PACKET, seed)
+        for axis, values in zip(("x", "y", "z"), signal):
+            arr["samples"][axis] = values.reshape(n_packets, SAMPLES_PER_PACKET)
+    else:
+        for axis in ("x", "y", "z"):
+            arr["samples"][axis] = rng.integers(-2048, 2048, size=(n_packets, SAMPLES_PER_PACKET))
+    size = PACKET_DTYPE.itemsize
+    raw = arr.tobytes()
+    return [raw[i * size:(i + 1) * size] for i in range(n_packets)]
+
+
+def _measure(name, func, packets, repeat=3):
+    best = float("inf")
+    for _ in range(repeat):
+        start = time.perf_counter()
+        func(packets)
+        best = min(best, time.perf_counter() - start)
+    rate = len(packets) / best
+    print(f"{name:<34} {rate:>12,.0f} paquetes/s  {rate * SAMPLES_PER_PACKET:>14,.0f} muestras/s")
+    return rate
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--packets", type=int, default=20000)
+    args = parser.parse_args()
+
+    packets = synthetic_packets(args.packets)
+    print(f"{args.packets} paquetes de {len(packets[0])} bytes ({HEADER_DTYPE.itemsize} de cabecera)\n")
+
+    base = _measure("decode_packet (lista de dicts)", lambda p: [decode_packet(d) for d in p], packets)
+    single = _measure("decode_packet_arrays (por paquete)", lambda p: [decode_packet_arrays(d) for d in p], packets)
+    batch = _measure("decode_packets (lista)", decode_packets, packets)
+    joined = b"".join(packets)
+    concat = _measure("decode_packets (buffer concatenado)", lambda _: decode_packets(joined), packets)
+
+    print(f"\nAceleración frente a decode_packet: por paquete x{single / base:.1f}, "
+          f"lote x{batch / base:.1f}, buffer x{concat / base:.1f}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,121 @@
+"""Benchmark de features por ventana deslizante: ventanas/s del motor incremental frente a
+recalcular cada ventana desde cero (con NumPy, y en Python puro sobre listas de dicts).
+
+Simula varios dispositivos con señal de caminar, en paquetes de 35 muestras como los reales.
+Todos los modos reciben los mismos paquetes intercalados entre dispositivos.
+
+Uso (desde TFM_Raspi/):
+  python -m benchmarks.bench_features [--devices 6] [--seconds 600] [--batch 64] [--window 2] [--hop 0.5]
+"""
+import argparse
+import time
+
+import numpy as np
+
+from modules.simulator import realistic_signal
+from modules.features import HOP_SECONDS, WINDOW_SECONDS, FeatureEngine, window_features
+from modules.packet_schema import SAMPLES_PER_PACKET
+
+
+def _streams(devices, seconds, rate=100):
+    n = int(seconds * rate)
+    streams = []
+    for d in range(devices):
+        x, y, z = realistic_signal(n, seed=d, rate=rate)
+        streams.append((np.arange(n, dtype=np.int64) * (1_000_000 // rate), np.column_stack((x, y, z))))
+    return streams
+
+
+# Paquetes intercalados entre dispositivos, como llegan por BLE
+def _packets(streams):
+    n = len(streams[0][0])
+    for i in range(0, n, SAMPLES_PER_PACKET):
+        for d, (t, xyz) in enumerate(streams):
+            yield f"dev{d}", t[i:i + SAMPLES_PER_PACKET], xyz[i:i + SAMPLES_PER_PACKET]
+
+
+def _run_engine(streams, batch, window_s, hop_s):
+    engine = FeatureEngine(window_s, hop_s, batch_windows=batch)
+    results = []
+    engine.add_consumer(lambda alias, t_end, features, _: results.append((alias, t_end, features)))
+    start = time.perf_counter()
+    for alias, t, xyz in _packets(streams):
+        engine.add_samples(alias, t, xyz)
+    engine.flush()
+    return time.perf_counter() - start, results, engine
+
+
+# Desde cero con NumPy: buffer por dispositivo y window_features() completo en cada salto
+def _run_numpy(streams, window, hop):
+    results = []
+    buffers = {}
+    start = time.perf_counter()
+    for alias, t, xyz in _packets(streams):
+        buf_t, buf_xyz, count = buffers.get(alias, (t[:0], xyz[:0], 0))
+        buf_t, buf_xyz = np.concatenate((buf_t, t)), np.concatenate((buf_xyz, xyz))
+        for k in range(1, len(t) + 1):
+            if (count + k) % hop == 0 and count + k >= window:
+                end = len(buf_t) - len(t) + k
+                results.append((alias, int(buf_t[end - 1]), window_features(buf_xyz[end - window:end])))
+        buffers[alias] = (buf_t[-window:], buf_xyz[-window:], count + len(t))
+    return time.perf_counter() - start, results
+
+
+# Desde cero en Python puro sobre dicts {'x','y','z'} (solo momentos, sin FFT)
+def _run_python(streams, window, hop, rate=100):
+    results = 0
+    buffers = {}
+    start = time.perf_counter()
+    for alias, _, xyz in _packets(streams):
+        samples, count = buffers.get(alias, ([], 0))
+        for x, y, z in xyz.tolist():
+            samples.append({"x": x, "y": y, "z": z})
+            count += 1
+            if count % hop == 0 and count >= window:
+                w = samples[-window:]
+                for axis in ("x", "y", "z"):
+                    values = [s[axis] for s in w]
+                    mean = sum(values) / window
+                    var = sum((v - mean) ** 2 for v in values) / window
+                    rms = (sum(v * v for v in values) / window) ** 0.5
+                    jerk = sum(abs(b - a) for a, b in zip(values, values[1:])) / (window - 1) * rate
+                results += 1
+        buffers[alias] = (samples[-window:], count)
+    return time.perf_counter() - start, results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--devices", type=int, default=6)
+    parser.add_argument("--seconds", type=float, default=600)
+    parser.add_argument("--batch", type=int, default=64, help="Ventanas por FFT en el modo por lotes")
+    parser.add_argument("--window", type=float, default=WINDOW_SECONDS, help="Segundos por ventana")
+    parser.add_argument("--hop", type=float, default=HOP_SECONDS, help="Segundos entre ventanas")
+    args = parser.parse_args()
+
+    streams = _streams(args.devices, args.seconds)
+    print(f"{args.devices} dispositivos x {args.seconds:g} s a 100 Hz "
+          f"(ventana {args.window:g} s, salto {args.hop:g} s)\n")
+
+    rates = {}
+    for name, batch in (("incremental (FFT por ventana)", 1), (f"incremental (FFT cada {args.batch})", args.batch)):
+        elapsed, results, engine = _run_engine(streams, batch, args.window, args.hop)
+        rates[name] = len(results) / elapsed
+        print(f"{name:<34} {rates[name]:>12,.0f} ventanas/s")
+    elapsed, naive = _run_numpy(streams, engine.window, engine.hop)
+    print(f"{'desde cero (NumPy)':<34} {len(naive) / elapsed:>12,.0f} ventanas/s")
+    elapsed, count = _run_python(streams, engine.window, engine.hop)
+    print(f"{'desde cero (Python, dicts, sin FFT)':<34} {count / elapsed:>12,.0f} ventanas/s")
+
+    # Comprobación: mismas features que el cálculo desde cero
+    reference = {(alias, t_end): features for alias, t_end, features in naive}
+    error = max(np.max(np.abs(features - reference[(alias, t_end)]) / (np.abs(reference[(alias, t_end)]) + 1))
+                for alias, t_end, features in results)
+    realtime = args.devices / engine.hop * engine.rate
+    print(f"\nError relativo máximo frente al cálculo desde cero: {error:.2e}")
+    print(f"Necesario en tiempo real: {realtime:,.0f} ventanas/s "
+          f"(x{max(rates.values()) / realtime:,.0f} de margen)")
+
+
+if __name__ == "__main__":
+    main()
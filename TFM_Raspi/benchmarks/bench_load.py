@@ -0,0 +1,132 @@
+"""Prueba de carga sin hardware: pulseras simuladas (modules/simulator.py) contra el
+pipeline real de la Raspi (BLEManager -> decodificar -> almacén en hilo + rings).
+
+Para cada número de dispositivos se sube la frecuencia de muestreo por escalones hasta
+que el host deja de dar abasto. Con control de flujo por créditos un host lento no
+acumula cola sin límite: los dispositivos se quedan sin créditos y descartan. Un escalón
+se supera si no hay descartes (en el dispositivo, en las colas del pipeline o en el
+almacén) y el bucle asyncio no se retrasa más de 250 ms. El punto de saturación es el
+último escalón superado, en paquetes/s totales.
+El simulador comparte proceso y bucle asyncio con el host: su coste también cuenta, así
+que el resultado es una cota inferior de lo que aguanta el host con BLE real.
+
+Uso (desde TFM_Raspi/):
+  python -m benchmarks.bench_load [--devices 6 20 50] [--rates 100,200,500,1000,2000,5000,10000]
+                                  [--seconds 5] [--jitter 5] [--loss 0] [--sin-almacen] [--trazas]
+Con --trazas cada escalón imprime además sus latencias por tramo (modules/tracing.py).
+"""
+import argparse
+import asyncio
+import shutil
+import tempfile
+import time
+
+from modules.ble_manager import BLEManager
+from modules.packet_schema import SAMPLES_PER_PACKET
+from modules.sample_ring import SampleRingSink
+from modules.session_store import BackgroundSink, SessionStoreSink
+from modules.simulator import SimulatedTransport
+from modules.tracing import LoopLagProbe, PacketTracer
+
+MAX_LOOP_LAG = 0.25
+
+
+def _snapshot(ble, transport, store):
+    stages = {s["stage"]: s for s in ble.pipeline.stats()}
+    return {
+        **transport.totals(),
+        # La etapa "store" también procesa los registros de hueco de la secuenciación
+        "received": stages["store"]["processed"] - sum(s["gaps"] for s in ble.sequencer.stats().values()),
+        "queue_dropped": sum(s["dropped"] for s in stages.values() if s["stage"] != "print"),
+        "store_dropped": store.dropped if store is not None else 0,
+        "cpu": time.process_time(),
+        "wall": time.perf_counter(),
+    }
+
+
+async def run_step(devices, rate_hz, seconds, jitter_ms, loss, use_store, trace=False):
+    transport = SimulatedTransport.fleet(devices, rate_hz=rate_hz, jitter_ms=jitter_ms, loss=loss)
+    ble = BLEManager(transport=transport)
+    ble.verbose = False
+    ble.tracer = PacketTracer() if trace else None
+    root = tempfile.mkdtemp(prefix="tfm_load_")
+    store = BackgroundSink(SessionStoreSink(root=root, session="carga")) if use_store else None
+    if store is not None:
+        ble.add_sink(store)
+    ble.add_sink(SampleRingSink())
+
+    await ble.start_scanning()
+    candidates = []
+    while len(candidates) < devices:
+        candidates = await ble.scan_available()
+        await asyncio.sleep(0.1)
+    await ble.connect_many([(c, f"Sim_{i + 1}") for i, c in enumerate(candidates)])
+    await ble.start_listening()
+
+    await asyncio.sleep(1.0)  # Arranque: ventana inicial de créditos, colas en régimen
+    lag = LoopLagProbe()
+    lag.start()
+    before = _snapshot(ble, transport, store)
+    await asyncio.sleep(seconds)
+    after = _snapshot(ble, transport, store)
+    lag.stop()
+
+    await ble.stop_listening()
+    await ble.disconnect_all()
+    if store is not None:
+        store.close()
+    shutil.rmtree(root, ignore_errors=True)
+
+    delta = {key: after[key] - before[key] for key in before}
+    dropped = delta["dropped"] + delta["queue_dropped"] + delta["store_dropped"]
+    return {
+        "devices": devices,
+        "rate_hz": rate_hz,
+        "packets_per_s": delta["generated"] / delta["wall"],
+        "received_per_s": delta["received"] / delta["wall"],
+        # Enviados o retenidos que aún no han llegado al almacén al final de la medida
+        "backlog": after["generated"] - after["lost"] - after["dropped"] - after["received"],
+        "dropped": dropped,
+        "cpu_percent": 100 * delta["cpu"] / delta["wall"],
+        "loop_lag_ms": lag.histogram.max,
+        "sustained": dropped == 0 and lag.histogram.max < MAX_LOOP_LAG * 1000,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--devices", type=int, nargs="+", default=[6, 20, 50])
+    parser.add_argument("--rates", default="100,200,500,1000,2000,5000,10000", help="Escalones de frecuencia (Hz)")
+    parser.add_argument("--seconds", type=float, default=5.0, help="Duración de la medida por escalón")
+    parser.add_argument("--jitter", type=float, default=5.0, help="Jitter de entrega (ms)")
+    parser.add_argument("--loss", type=float, default=0.0, help="Probabilidad de perder un paquete")
+    parser.add_argument("--sin-almacen", action="store_true", help="Sin SessionStoreSink (solo decodificar)")
+    parser.add_argument("--trazas", action="store_true", help="Latencias por tramo de cada escalón")
+    args = parser.parse_args()
+    rates = [int(r) for r in args.rates.split(",")]
+
+    print(f"{'Disp.':>5} {'Hz':>6} {'paq/s':>8} {'recibidos/s':>11} {'pendientes':>10} {'descartes':>9} "
+          f"{'CPU':>5} {'retraso bucle':>14}")
+    saturation = {}
+    for devices in args.devices:
+        for rate in rates:
+            r = asyncio.run(run_step(devices, rate, args.seconds, args.jitter, args.loss, not args.sin_almacen,
+                                     args.trazas))
+            mark = "" if r["sustained"] else "  <- saturado"
+            print(f"{devices:>5} {rate:>6} {r['packets_per_s']:>8,.0f} {r['received_per_s']:>11,.0f} "
+                  f"{r['backlog']:>10} {r['dropped']:>9} {r['cpu_percent']:>4.0f}% {r['loop_lag_ms']:>11.1f} ms{mark}")
+            if not r["sustained"]:
+                break
+            saturation[devices] = r
+    print("\nPunto de saturación (último escalón superado):")
+    for devices in args.devices:
+        r = saturation.get(devices)
+        if r is None:
+            print(f" * {devices} dispositivos: ni siquiera el primer escalón")
+        else:
+            print(f" * {devices} dispositivos: {r['rate_hz']} Hz por dispositivo, "
+                  f"{r['packets_per_s']:,.0f} paquetes/s ({r['packets_per_s'] * SAMPLES_PER_PACKET:,.0f} muestras/s)")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,317 @@
+"""Suite de rendimiento del host con datos sintéticos, resultados en JSON y comparación
+entre revisiones.
+
+Métricas:
+  decode_*           Paquetes/s de los decodificadores (por paquete y por lotes)
+  store_*            Paquetes/s que escribe SessionStoreSink (sin hilo, sin pipeline)
+  latency_*          Extremo a extremo desde la notificación (encolado en BLEManager) hasta
+                     que el paquete está escrito en el almacén, con 6 pulseras simuladas a
+                     100 Hz en tiempo real (modules/simulator.py)
+  cpu_per_device     % de CPU del proceso por dispositivo en esa misma prueba (incluye el
+                     simulador: es una cota superior)
+  disk_*             Bytes en disco por dispositivo y hora (segmentos + rollups, y tras compactar)
+  ram_per_device     Bytes de memoria por dispositivo (rings, reloj, escritor del almacén)
+
+Uso (desde TFM_Raspi/):
+  python -m benchmarks.suite [--out resultados.json] [--seconds 10] [--repeat 3]
+  python -m benchmarks.suite --compare base.json [--out nuevo.json] [--threshold 0.15]
+  python -m benchmarks.suite --compare base.json --current nuevo.json   # Sin medir
+Con --compare el código de salida es 1 si la mediana de alguna métrica empeora más que el
+umbral o si falta alguna métrica de la referencia. La dispersión entre repeticiones solo se informa: si supera el umbral la comparación
+de esa métrica es poco fiable y conviene repetir con más --repeat.
+"""
+import argparse
+import asyncio
+import json
+import os
+import platform
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+import tracemalloc
+
+import numpy as np
+
+from benchmarks.bench_decode import synthetic_packets
+from modules.ble_manager import BLEManager
+from modules.data_handler import decode_packet, decode_packet_arrays, decode_packets
+from modules.packet_schema import SAMPLES_PER_PACKET
+from modules.sample_ring import SampleRingSink
+from modules.session_store import BackgroundSink, SessionStoreSink
+from modules.simulator import SimulatedTransport
+from modules.storage_maintenance import compact_device
+
+SCHEMA = 1
+DEFAULT_THRESHOLD = 0.15  # Empeoramiento relativo que se marca como regresión
+
+
+# tolerance: diferencia absoluta por debajo de la cual no se marca nada (ruido de medida)
+def _metric(value, unit, better, tolerance=0.0):
+    return {"value": float(value), "unit": unit, "better": better, "tolerance": tolerance}
+
+
+def _best_rate(func, count, repeat=3):
+    best = float("inf")
+    for _ in range(repeat):
+        start = time.perf_counter()
+        func()
+        best = min(best, time.perf_counter() - start)
+    return count / best
+
+
+def _dir_bytes(path):
+    return sum(os.path.getsize(os.path.join(d, f)) for d, _, files in os.walk(path) for f in files)
+
+
+# ------------------------------ MEDIDAS ------------------------------
+
+def bench_decode(n_packets=20000):
+    packets = synthetic_packets(n_packets, realistic=True)
+    joined = b"".join(packets)
+    return {
+        "decode_dicts": _metric(_best_rate(lambda: [decode_packet(p) for p in packets], n_packets),
+                                "paquetes/s", "higher"),
+        "decode_arrays": _metric(_best_rate(lambda: [decode_packet_arrays(p) for p in packets], n_packets),
+                                 "paquetes/s", "higher"),
+        "decode_batch": _metric(_best_rate(lambda: decode_packets(joined), n_packets), "paquetes/s", "higher"),
+    }
+
+
+# Paquetes decodificados con su hora de llegada (1 dispositivo, tiempo real simulado)
+def _decoded_stream(n_packets):
+    period_ns = SAMPLES_PER_PACKET * 10_000_000
+    t0 = time.monotonic_ns()
+    return [(t0 + i * period_ns, decode_packet_arrays(data))
+            for i, data in enumerate(synthetic_packets(n_packets, realistic=True))]
+
+
+def bench_storage(n_packets=6000):
+    stream = _decoded_stream(n_packets)
+    root = tempfile.mkdtemp(prefix="tfm_suite_")
+    try:
+        sink = SessionStoreSink(root=root, session="suite")
+        start = time.perf_counter()
+        for i, (t_recv, packet) in enumerate(stream):
+            sink(f"dev{i % 6}", t_recv, packet)
+        sink.sync()
+        rate = n_packets / (time.perf_counter() - start)
+        sink.close()
+    finally:
+        shutil.rmtree(root, ignore_errors=True)
+    return {"store_sync": _metric(rate, "paquetes/s", "higher")}
+
+
+# Disco por dispositivo y hora: 10 min de un dispositivo a 100 Hz, escalado a una hora
+def bench_disk(seconds=600):
+    n_packets = int(seconds * 100 / SAMPLES_PER_PACKET)
+    root = tempfile.mkdtemp(prefix="tfm_suite_")
+    try:
+        sink = SessionStoreSink(root=root, session="suite")
+        for t_recv, packet in _decoded_stream(n_packets):
+            sink("dev", t_recv, packet)
+        sink.writers["dev"].rotate()  # Sella el segmento para poder compactarlo
+        sink.close()
+        device_dir = os.path.join(root, "suite", "dev")
+        plain = _dir_bytes(device_dir)
+        compact_device(device_dir)
+        compacted = _dir_bytes(device_dir)
+    finally:
+        shutil.rmtree(root, ignore_errors=True)
+    scale = 3600 / (n_packets * SAMPLES_PER_PACKET / 100)
+    return {
+        "disk_per_device_hour": _metric(plain * scale, "bytes", "lower"),
+        "disk_compact_per_device_hour": _metric(compacted * scale, "bytes", "lower"),
+    }
+
+
+# Memoria que añade cada dispositivo: estado por dispositivo tras 10 min de datos
+def bench_ram(devices=6, seconds=600):
+    n_packets = int(seconds * 100 / SAMPLES_PER_PACKET)
+    stream = _decoded_stream(n_packets)
+    root = tempfile.mkdtemp(prefix="tfm_suite_")
+    try:
+        tracemalloc.start()
+        before = tracemalloc.get_traced_memory()[0]
+        rings = SampleRingSink()
+        store = SessionStoreSink(root=root, session="suite")
+        for t_recv, packet in stream:
+            for d in range(devices):
+                rings(f"dev{d}", t_recv, packet)
+                store(f"dev{d}", t_recv, packet)
+        after = tracemalloc.get_traced_memory()[0]
+        tracemalloc.stop()
+        store.close()
+    finally:
+        shutil.rmtree(root, ignore_errors=True)
+    return {"ram_per_device": _metric((after - before) / devices, "bytes", "lower")}
+
+
+# Sink envuelto que anota, ya escrito el paquete, cuánto tardó desde la notificación
+class _TimedSink:
+    def __init__(self, sink):
+        self.sink = sink
+        self.latencies = []
+
+    def __call__(self, alias, t_recv, packet):
+        self.sink(alias, t_recv, packet)
+        self.latencies.append(time.monotonic_ns() - t_recv)
+
+    def close(self):
+        self.sink.close()
+
+
+async def _end_to_end(devices, seconds):
+    transport = SimulatedTransport.fleet(devices, jitter_ms=0)
+    ble = BLEManager(transport=transport)
+    ble.verbose = False
+    root = tempfile.mkdtemp(prefix="tfm_suite_")
+    timed = _TimedSink(SessionStoreSink(root=root, session="suite"))
+    store = BackgroundSink(timed)
+    ble.add_sink(store)
+    ble.add_sink(SampleRingSink())
+    try:
+        await ble.start_scanning()
+        candidates = []
+        while len(candidates) < devices:
+            candidates = await ble.scan_available()
+            await asyncio.sleep(0.1)
+        await ble.connect_many([(c, f"Sim_{i + 1}") for i, c in enumerate(candidates)])
+        await ble.start_listening()
+        await asyncio.sleep(1.0)
+        timed.latencies.clear()
+        cpu, wall = time.process_time(), time.perf_counter()
+        await asyncio.sleep(seconds)
+        cpu, wall = time.process_time() - cpu, time.perf_counter() - wall
+        latencies = np.array(timed.latencies, dtype=np.float64) / 1e6
+        await ble.stop_listening()
+        await ble.disconnect_all()
+        store.close()
+    finally:
+        shutil.rmtree(root, ignore_errors=True)
+    return latencies, 100 * cpu / wall / devices
+
+
+def bench_end_to_end(devices=6, seconds=10.0):
+    latencies, cpu = asyncio.run(_end_to_end(devices, seconds))
+    # Tolerancias pequeñas frente a los 350 ms de un paquete: unos ms de más son planificación del SO
+    results = {f"latency_p{p}": _metric(np.percentile(latencies, p), "ms", "lower", 5.0) for p in (50, 95, 99)}
+    results["latency_max"] = _metric(latencies.max(), "ms", "lower", 20.0)
+    results["cpu_per_device"] = _metric(cpu, "% CPU", "lower", 0.1)
+    return results
+
+
+# ------------------------------ RESULTADOS ------------------------------
+
+def _revision():
+    try:
+        return subprocess.run(["git", "describe", "--always", "--dirty"], capture_output=True, text=True,
+                              cwd=os.path.dirname(os.path.abspath(__file__)), timeout=5).stdout.strip() or None
+    except (OSError, subprocess.TimeoutExpired):
+        return None
+
+
+# Las medidas rápidas se repiten "repeat" veces y se guarda la mediana y su dispersión
+# relativa ((máx - mín) / mediana), que la comparación muestra como ruido de la medida.
+def run_suite(seconds, repeat=3):
+    metrics = {}
+    for name, bench, times in (("decodificación", bench_decode, repeat), ("almacén", bench_storage, repeat),
+                               ("disco", bench_disk, 1), ("memoria", bench_ram, 1),
+                               ("extremo a extremo", lambda: bench_end_to_end(seconds=seconds), 1)):
+        print(f"Midiendo {name}...", file=sys.stderr)
+        runs = [bench() for _ in range(times)]
+        for key, m in runs[0].items():
+            values = [run[key]["value"] for run in runs]
+            m["value"] = float(np.median(values))
+            m["spread"] = (max(values) - min(values)) / abs(m["value"]) if m["value"] else 0.0
+            metrics[key] = m
+    return {
+        "schema": SCHEMA,
+        "meta": {
+            "revision": _revision(),
+            "date": time.strftime("%Y-%m-%d %H:%M:%S"),
+            "python": platform.python_version(),
+            "numpy": np.__version__,
+            "machine": platform.machine(),
+            "platform": platform.platform(),
+        },
+        "metrics": metrics,
+    }
+
+
+def print_results(results):
+    print(f"Revisión {results['meta']['revision']} ({results['meta']['machine']}, {results['meta']['date']})")
+    for name, m in results["metrics"].items():
+        print(f"  {name:<30} {m['value']:>16,.2f} {m['unit']}")
+
+
+# Compara dos resultados. Devuelve las métricas cuya mediana empeora más que "threshold".
+# La dispersión no mueve el umbral (si no, una medida ruidosa ocultaría cualquier regresión):
+# solo se avisa cuando es mayor que el umbral. Una métrica de la base que falta en la
+# actual (prueba que falló o se quitó) también cuenta como regresión.
+def compare(base, current, threshold=DEFAULT_THRESHOLD):
+    print(f"Base {base['meta']['revision']} ({base['meta']['machine']}) -> "
+          f"actual {current['meta']['revision']} ({current['meta']['machine']})")
+    if base["meta"]["machine"] != current["meta"]["machine"]:
+        print("  [AVISO] Máquinas distintas: las diferencias no son solo del código")
+    regressions = []
+    for name, m in current["metrics"].items():
+        old = base["metrics"].get(name)
+        if old is None or not old["value"]:
+            print(f"  {name:<30} {'':>14} {m['value']:>14,.2f} {m['unit']}  (nueva)")
+            continue
+        change = (m["value"] - old["value"]) / abs(old["value"])
+        worse = -change if m["better"] == "higher" else change
+        noise = max(old.get("spread", 0.0), m.get("spread", 0.0))
+        flag = ""
+        if abs(m["value"] - old["value"]) <= m.get("tolerance", 0.0):
+            pass
+        elif worse > threshold:
+            flag = "  <- REGRESIÓN"
+            regressions.append(name)
+        elif -worse > threshold:
+            flag = "  (mejora)"
+        if noise > threshold:
+            flag += f"  [ruido ±{noise:.0%}]"
+        print(f"  {name:<30} {old['value']:>14,.2f} {m['value']:>14,.2f} {m['unit']:<11} {change:>+7.1%}{flag}")
+    for name, old in base["metrics"].items():
+        if name not in current["metrics"]:
+            print(f"  {name:<30} {old['value']:>14,.2f} {'':>14} {old['unit']:<11}  <- FALTA")
+            regressions.append(name)
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--out", help="Guarda los resultados en este JSON")
+    parser.add_argument("--compare", help="JSON de referencia (revisión anterior)")
+    parser.add_argument("--current", help="Con --compare: JSON a comparar en lugar de medir ahora")
+    parser.add_argument("--threshold", type=float, default=DEFAULT_THRESHOLD, help="Empeoramiento máximo (0.15 = 15 %%)")
+    parser.add_argument("--seconds", type=float, default=10.0, help="Duración de la prueba extremo a extremo")
+    parser.add_argument("--repeat", type=int, default=3, help="Repeticiones de las medidas rápidas (mediana)")
+    args = parser.parse_args()
+
+    if args.current:
+        with open(args.current, encoding="utf-8") as f:
+            results = json.load(f)
+    else:
+        results = run_suite(args.seconds, args.repeat)
+        print_results(results)
+    if args.out:
+        with open(args.out, "w", encoding="utf-8") as f:
+            json.dump(results, f, indent=2, ensure_ascii=False)
+
+    if args.compare:
+        with open(args.compare, encoding="utf-8") as f:
+            base = json.load(f)
+        print()
+        regressions = compare(base, results, args.threshold)
+        if regressions:
+            print(f"\n{len(regressions)} regresión(es) por encima del {args.threshold:.0%}: {', '.join(regressions)}")
+            sys.exit(1)
+        print("\nSin regresiones.")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,37 @@
+import os
+
+# Configuración del programa. El modo servicio (python main.py --servicio) no pregunta
+# nada: todo sale de aquí y del registro de dispositivos.
+
+BASE_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# Registro persistente MAC -> posición. Lo escribe el menú interactivo al registrar un
+# dispositivo y lo lee el modo servicio al arrancar.
+REGISTRY_PATH = os.path.join(BASE_DIR, "config", "devices.json")
+
+# Con --simulador las pulseras virtuales usan su propio registro y sus propias sesiones:
+# registrar una posición no sustituye a la pulsera real ni se mezclan datos falsos con data/raw
+SIM_REGISTRY_PATH = os.path.join(BASE_DIR, "config", "devices_sim.json")
+SIM_DATA_DIR = os.path.join(BASE_DIR, "data", "sim")
+
+# Posiciones del cuerpo que puede ocupar un dispositivo (alias)
+POSICIONES = {
+    "1": "Mano_Izquierda",
+    "2": "Mano_Derecha",
+    "3": "Tobillo_Izquierdo",
+    "4": "Tobillo_Derecho",
+    "5": "Cadera_Izquierda",
+    "6": "Cadera_Derecha",
+}
+
+# Opciones con las que arranca el modo servicio (las mismas que en la línea de comandos)
+SERVICE_FLAGS = ["--wal", "--metricas"]
+
+SERVICE_SCAN_TIMEOUT = 20.0     # s esperando el anuncio de cada dispositivo conocido al arrancar
+SERVICE_STATUS_INTERVAL = 300.0 # s entre resúmenes de estado en el log del servicio
+SERVICE_PRINT_PACKETS = False   # Sin una línea por paquete en el journal
+
+# Métricas para Prometheus (--metricas: HTTP; --metricas=<fichero.prom>: textfile collector)
+METRICS_HOST = "127.0.0.1"      # Solo local; "0.0.0.0" para que Prometheus lo lea desde otra máquina
+METRICS_PORT = 9108
+METRICS_INTERVAL = 10.0         # s entre cálculos de tasas (y escrituras del fichero)
@@ -1,20 +1,28 @@
 import asyncio
 import signal
 import sys
+import time
+from functools import partial
+from config.settings import (METRICS_HOST, METRICS_INTERVAL, METRICS_PORT, POSICIONES, REGISTRY_PATH,
+                             SERVICE_FLAGS, SERVICE_PRINT_PACKETS, SERVICE_SCAN_TIMEOUT, SERVICE_STATUS_INTERVAL,
+                             SIM_DATA_DIR, SIM_REGISTRY_PATH)
 from modules.ble_manager import BLEManager
+from modules.capture_log import CaptureLog, LogReplayer
+from modules.inference import InferenceSink
+from modules.metrics import MetricsExporter
+from modules.multiproc import ProcessHost
+from modules.registry import DeviceRegistry
+from modules.sample_ring import SampleRingSink
+from modules.session_store import DATA_RAW_DIR, BackgroundSink, SessionStoreSink
+from modules.shm_ring import ShmRingSink
+from modules.storage_maintenance import RetentionPolicy, StorageMaintainer
+from modules.tracing import PacketTracer
 
 # Funciones auxiliares
 
 async def seleccionar_posicion():
     
-    opciones_validas = {
-        "1": "Mano_Izquierda",
-        "2": "Mano_Derecha",
-        "3": "Tobillo_Izquierdo",
-        "4": "Tobillo_Derecho",
-        "5": "Cadera_Izquierda",
-        "6": "Cadera_Derecha"
-    }
+    opciones_validas = POSICIONES
 
     while True:
         print("\n--- Seleccione posición del dispositivo ---")
@@ -36,9 +44,7 @@ async def seleccionar_posicion():
             print(f"ERROR: '{eleccion}' no es válido. Debe elegir un número del 1 al 6.")
 
 
-async def main():
-    ble = BLEManager()
-
+async def menu(ble, registry):
     # Menu principal
     while True:
         # Mostramos lista de conectados
@@ -49,7 +55,8 @@ async def main():
             print(" (Ningún dispositivo enlazado)")
         else:
             for mac, info in devs.items():
-                print(f" * {info['alias']} [{mac}]")
+                state = " (reconectando...)" if info.get('state') == "reconectando" else ""
+                print(f" * {info['alias']} [{mac}]{state}")
         print("="*40)
 
         print("1. Registrar un nuevo dispositivo")
@@ -62,14 +69,9 @@ async def main():
             # Si el usuario solo dio a Enter, se refresca el menú
             continue
         elif choice == "1": # Registrar nuevo dispositivo
-            print("\nBuscando dispositivos cercanos...")
-            candidates = await ble.scan_available()
-            
-            valid_candidates = []
-            for d in candidates:
-                # Que tenga nombre y no esté ya conectado
-                if d.name and d.address not in ble.connected_devices:
-                    valid_candidates.append(d)
+            # El escáner en segundo plano ya tiene la tabla: solo dispositivos con el
+            # servicio del acelerómetro, más cercanos primero
+            valid_candidates = await ble.scan_available()
 
             if not valid_candidates:
                 print(">> No se encontraron dispositivos nuevos.")
@@ -77,20 +79,28 @@ async def main():
 
             print("\n--- Dispositivos Disponibles ---")
             for i, d in enumerate(valid_candidates):
-                print(f"[{i}] {d.name} ({d.address})")
+                state = ", vinculado" if d.locked else ""
+                print(f"[{i}] {d.name} ({d.address})  RSSI {d.rssi} dBm, visto hace {d.age():.1f} s{state}")
             
-            sel = await asyncio.to_thread(input, ">> Nº disp. (o 'BACK' para volver): ")
+            sel = await asyncio.to_thread(input, ">> Nº disp. separados por comas (o 'BACK' para volver): ")
             if sel.strip().upper() == "BACK":
                 continue
             
             try:
-                idx = int(sel)
-                if 0 <= idx < len(valid_candidates):
-                    target = valid_candidates[idx]
-                    alias = await seleccionar_posicion()
-                    
-                    # Proceso de conexión
-                    await ble.connect_and_register(target, alias)
+                indices = [int(part) for part in sel.replace(" ", "").split(",") if part]
+                if indices and all(0 <= idx < len(valid_candidates) for idx in indices):
+                    # Primero se asignan todas las posiciones y después se conecta a la vez
+                    targets = []
+                    for idx in dict.fromkeys(indices):
+                        print(f"\n{valid_candidates[idx].name} ({valid_candidates[idx].address}):")
+                        alias = await seleccionar_posicion()
+                        targets.append((valid_candidates[idx], alias))
+
+                    # Proceso de conexión; los que conectan quedan en el registro persistente
+                    await ble.connect_many(targets)
+                    for device, alias in targets:
+                        if device.address in ble.connected_devices:
+                            registry.add(device.address, alias, device.name)
                 else:
                     print(">> Número inválido.")
             except ValueError:
@@ -119,8 +129,166 @@ async def main():
         else:
             print("Opción no válida.")
 
+
+# Modo servicio: conexión en paralelo a todos los dispositivos conocidos y grabación
+# inmediata. Informa del tiempo desde el arranque de la Raspi hasta que todos transmiten.
+async def servicio(ble, registry):
+    known = registry.known()
+    if not known:
+        print(f"[Servicio] El registro está vacío ({registry.path}): registre los dispositivos desde el menú.")
+        return
+
+    ble.verbose = SERVICE_PRINT_PACKETS
+    stop = asyncio.Event()
+    loop = asyncio.get_running_loop()
+    for sig in (signal.SIGTERM, signal.SIGINT):
+        loop.add_signal_handler(sig, stop.set)
+
+    # Reloj desde el arranque del sistema (CLOCK_BOOTTIME) y su desfase con monotonic
+    boot_offset_ns = time.clock_gettime_ns(time.CLOCK_BOOTTIME) - time.monotonic_ns()
+    started_ns = time.monotonic_ns()
+    print(f"[Servicio] Conectando a {len(known)} dispositivos: {', '.join(alias for _, alias in known)}")
+
+    await ble.connect_known(known, SERVICE_SCAN_TIMEOUT)
+    await ble.start_listening()
+
+    # Todos transmitiendo = primer paquete recibido de cada dispositivo conocido (los que
+    # no estaban a la vista cuentan cuando el supervisor de reconexión los recupera)
+    async def report_streaming():
+        pending = {mac for mac, _ in known}
+        while pending - ble.first_packet.keys():
+            await asyncio.sleep(0.05)
+        last = max(ble.first_packet[mac] for mac in pending)
+        print(f"[Servicio] Todos transmitiendo: {(last + boot_offset_ns) / 1e9:.1f} s desde el arranque de la Raspi "
+              f"({(last - started_ns) / 1e9:.2f} s desde el inicio del servicio)")
+
+    report = asyncio.create_task(report_streaming())
+    while not stop.is_set():
+        try:
+            await asyncio.wait_for(stop.wait(), timeout=SERVICE_STATUS_INTERVAL)
+        except asyncio.TimeoutError:
+            states = [f"{info['alias']}: {info.get('state', 'conectado')}" for info in ble.connected_devices.values()]
+            print(f"[Servicio] {'; '.join(states)}")
+            if ble.tracer is not None:
+                ble.tracer.print_report()
+
+    report.cancel()
+    print("[Servicio] Parada solicitada.")
+    await ble.stop_listening()
+
+
+async def main():
+    # Con "--simulador[=N]" no se usa Bluetooth: N pulseras virtuales (6 por defecto,
+    # modules/simulator.py) con paquetes idénticos a los del firmware. Registro y sesiones
+    # van aparte (config/devices_sim.json, data/sim) para no tocar los de las pulseras reales.
+    simulated = [arg for arg in sys.argv[1:] if arg.split("=")[0] == "--simulador"]
+    transport = None
+    data_dir = DATA_RAW_DIR
+    registry_path = REGISTRY_PATH
+    if simulated:
+        from modules.simulator import SimulatedTransport  # Solo aquí: el servicio no lo necesita
+        count = int(simulated[0].split("=")[1]) if "=" in simulated[0] else 6
+        transport = SimulatedTransport.fleet(count)
+        data_dir = SIM_DATA_DIR
+        registry_path = SIM_REGISTRY_PATH
+    ble = BLEManager(transport=transport)
+    registry = DeviceRegistry(registry_path)
+
+    # Con "--servicio" no hay menú: se conecta a los dispositivos del registro y se graba
+    # hasta recibir SIGTERM/SIGINT (systemd). Las opciones salen de config/settings.py.
+    args = set(sys.argv[1:])
+    if "--servicio" in args:
+        args |= set(SERVICE_FLAGS)
+
+    # Con "--multiproceso" este proceso solo gestiona el BLE; decodificación,
+    # almacenamiento e inferencia se reparten en procesos (uno por núcleo)
+    # Con "--shm" las muestras decodificadas se publican en memoria compartida
+    # (/dev/shm/tfm_ring_<alias>) para que otros procesos locales las lean sin copias
+    # Las sesiones se guardan en data/raw/<fecha_hora>/<alias>/seg_NNNNNN/ (formato columnar,
+    # un segmento nuevo por tamaño o por hora de grabación)
+    consumers = {"store": partial(SessionStoreSink, root=data_dir), "inference": None}
+    local_sinks = []
+
+    # Con "--wal" cada notificación cruda se añade primero a data/raw/<sesión>/capture.log
+    # (fsync en grupo) y el volcado al almacén se hace en segundo plano desde el log
+    replayer = None
+    if "--wal" in args:
+        store = SessionStoreSink(root=data_dir)
+        ble.capture_log = CaptureLog(store.session_dir)
+        replayer = LogReplayer(ble.capture_log, store)
+        replayer.start()
+        consumers["store"] = None
+    if "--shm" in args:
+        consumers["shm"] = ShmRingSink
+    # Con "--inferencia" se calculan features por ventana y se evalúa el modelo de
+    # data/models por lotes (todos los dispositivos en una llamada)
+    if "--inferencia" in args:
+        consumers["inference"] = InferenceSink
+    if "--multiproceso" not in args:
+        local_sinks = [factory() for factory in consumers.values() if factory is not None]
+        # El almacenamiento escribe desde un hilo: una tarjeta SD lenta no frena la recepción
+        local_sinks = [BackgroundSink(sink) if isinstance(sink, SessionStoreSink) else sink
+                       for sink in local_sinks]
+        for sink in local_sinks:
+            ble.add_sink(sink)
+        # Historial reciente en memoria (últimos 10 min por dispositivo, tamaño fijo)
+        ble.rings = SampleRingSink()
+        ble.add_sink(ble.rings)
+
+    # Con "--trazas" cada paquete se marca en adquisición, envío, recepción, decodificación y
+    # almacenamiento: histogramas de latencia por tramo y dispositivo + retraso del bucle asyncio
+    if "--trazas" in args:
+        if "--multiproceso" in args:
+            print("[Trazas] No disponibles en modo multiproceso (la decodificación va en otro proceso).")
+        else:
+            ble.tracer = PacketTracer()
+
+    # Con "--metricas" se sirven métricas en formato Prometheus en http://METRICS_HOST:METRICS_PORT/metrics;
+    # con "--metricas=<fichero.prom>" se escriben en ese fichero (textfile collector de node_exporter).
+    # Los percentiles de latencia salen de las trazas, que se activan con las métricas.
+    exporter = None
+    metrics_args = [arg for arg in args if arg.split("=")[0] == "--metricas"]
+    if metrics_args:
+        if "--multiproceso" in args:
+            print("[Métricas] No disponibles en modo multiproceso (la decodificación va en otro proceso).")
+        else:
+            textfile = metrics_args[0].split("=", 1)[1] if "=" in metrics_args[0] else None
+            exporter = MetricsExporter(ble, host=METRICS_HOST, port=None if textfile else METRICS_PORT,
+                                       textfile=textfile, interval=METRICS_INTERVAL)
+            ble.metrics = exporter
+            ble.tracer = ble.tracer or PacketTracer()
+            await exporter.start()
+
+    host = None
+    if "--multiproceso" in args:
+        host = ProcessHost(ble, consumers=consumers)
+        host.start(asyncio.get_running_loop())
+
+    # Compactación y retención de sesiones en segundo plano (E/S limitada)
+    maintainer = StorageMaintainer(root=data_dir, retention=RetentionPolicy())
+    maintainer.start()
+
+    # Escaneo continuo de dispositivos con el servicio del acelerómetro
+    await ble.start_scanning()
+
+    if "--servicio" in args:
+        await servicio(ble, registry)
+    else:
+        await menu(ble, registry)
+
     # Salida limpia
     await ble.disconnect_all()
+    if exporter is not None:
+        await exporter.stop()
+    if replayer is not None:
+        ble.capture_log.close()
+        await asyncio.to_thread(replayer.stop)
+        replayer.store.close()
+    if host is not None:
+        await asyncio.to_thread(host.stop)
+    for sink in local_sinks:
+        sink.close()
+    await asyncio.to_thread(maintainer.stop)
     print("Sistema apagado.")
 
 if __name__ == "__main__":
@@ -0,0 +1,169 @@
+import numpy as np
+
+from modules.data_handler import DeviceClock, sample_timestamps_us
+
+# Alineación de varios dispositivos en una sola línea temporal.
+# Cada paquete se pasa a tiempo de la Raspi (DeviceClock), se guarda en un buffer por
+# dispositivo y, cuando todos han llegado a un instante (o el más adelantado les saca
+# más de "lateness_us"), se remuestrea esa parte en una rejilla uniforme común con
+# np.interp. Las muestras que llegan después de emitir su tramo se descartan.
+# Es una biblioteca para consumidores de tramas multi-dispositivo (análisis, modelos que
+# miran todo el cuerpo a la vez): main.py no la registra porque aún no hay ninguno en
+# tiempo real; basta con ble.add_sink(StreamAligner(...)) y add_consumer().
+
+GRID_RATE_HZ = 100
+LATENESS_US = 500_000   # Espera máxima a un rezagado (> duración de un paquete, 350 ms, + jitter)
+MAX_BUFFER = 4096       # Muestras máximas retenidas por dispositivo (memoria acotada)
+MAX_GAP_US = 50_000     # Huecos mayores (paquetes perdidos) no se interpolan: quedan NaN
+MAX_FRAME_ROWS = 1024   # Instantes de la rejilla por trama como máximo (memoria acotada)
+
+
+class _DeviceBuffer:
+    def __init__(self):
+        self.clock = DeviceClock()
+        self.t = np.zeros(0, dtype=np.int64)
+        self.xyz = np.zeros((0, 3), dtype=np.float32)
+        self.latest = None  # Último instante recibido (µs, tiempo de la Raspi)
+
+    def add(self, t, xyz):
+        if len(self.t) and t[0] < self.t[-1]:
+            # Paquete fuera de orden: se mezcla y se reordena (estable)
+            t = np.concatenate((self.t, t))
+            xyz = np.concatenate((self.xyz, xyz))
+            order = np.argsort(t, kind="stable")
+            self.t, self.xyz = t[order], xyz[order]
+        else:
+            self.t = np.concatenate((self.t, t))
+            self.xyz = np.concatenate((self.xyz, xyz))
+        self.latest = int(self.t[-1])
+
+    # Descarta lo anterior a "t" salvo la última muestra previa (hace falta para interpolar)
+    def trim_before(self, t, max_buffer):
+        keep = max(int(np.searchsorted(self.t, t)) - 1, 0, len(self.t) - max_buffer)
+        if keep:
+            self.t = self.t[keep:]
+            self.xyz = self.xyz[keep:]
+
+
+# Sink (alias, t_recv_ns, packet) que emite tramas sincronizadas a los consumidores:
+#   frame = {"t": int64 (N,), "devices": [alias...], "data": float32 (N, D, 3)}
+# Un dispositivo sin datos alrededor de un instante de la rejilla queda como NaN.
+# Si ningún dispositivo tiene datos en un tramo largo (todos desconectados) no se emiten
+# sus filas NaN: se salta al primer dato con una sola trama vacía (N = 0) que lleva
+# además "skipped_us": (inicio, fin) del tramo omitido.
+class StreamAligner:
+    def __init__(self, devices=None, rate_hz=GRID_RATE_HZ, lateness_us=LATENESS_US, max_buffer=MAX_BUFFER,
+                 max_gap_us=MAX_GAP_US, max_frame_rows=MAX_FRAME_ROWS):
+        self.step_us = 1_000_000 // rate_hz
+        self.lateness_us = lateness_us
+        self.max_gap_us = max_gap_us
+        self.max_buffer = max_buffer
+        self.max_frame_rows = max_frame_rows
+        self.devices = list(devices or [])
+        self.buffers = {alias: _DeviceBuffer() for alias in self.devices}
+        self.consumers = []
+        self.next_t = None  # Próximo instante de la rejilla por emitir
+        self.frames = 0
+        self.late_samples = 0
+        self.skipped_us = 0  # Tiempo de rejilla omitido sin datos de ningún dispositivo
+
+    def add_consumer(self, consumer):
+        self.consumers.append(consumer)
+
+    def __call__(self, alias, t_recv, packet):
+        buffer = self.buffers.get(alias)
+        if buffer is None:
+            buffer = self.buffers[alias] = _DeviceBuffer()
+            self.devices.append(alias)
+
+        t = buffer.clock.to_host_us(sample_timestamps_us(packet), t_recv)
+        xyz = np.column_stack((packet["x"], packet["y"], packet["z"])).astype(np.float32)
+        if self.next_t is not None:
+            late = t < self.next_t - self.step_us
+            if late.any():
+                self.late_samples += int(late.sum())
+                t, xyz = t[~late], xyz[~late]
+                if len(t) == 0:
+                    return
+        buffer.add(t, xyz)
+
+        if self.next_t is None:
+            self.next_t = -(-int(t[0]) // self.step_us) * self.step_us
+        self._emit(self._watermark())
+
+    # Hasta dónde se puede emitir: todos los dispositivos han llegado, o el más
+    # adelantado supera al resto en más de lateness_us (no se espera a un rezagado).
+    # Un dispositivo registrado que aún no ha enviado nada también se espera.
+    def _watermark(self):
+        latest = [b.latest for b in self.buffers.values() if b.latest is not None]
+        slowest = min(latest) if len(latest) == len(self.buffers) else -1
+        return max(slowest, max(latest) - self.lateness_us)
+
+    # Primer instante con datos (>= next_t) de cualquier dispositivo
+    def _resume_t(self):
+        resume = None
+        for buffer in self.buffers.values():
+            i = int(np.searchsorted(buffer.t, self.next_t))
+            if i < len(buffer.t) and (resume is None or buffer.t[i] < resume):
+                resume = int(buffer.t[i])
+        return resume
+
+    # Emite hasta "until" en tramas de como mucho max_frame_rows instantes
+    def _emit(self, until):
+        while until >= self.next_t:
+            end_t = self.next_t + ((until - self.next_t) // self.step_us + 1) * self.step_us
+            resume = self._resume_t()
+            if resume is None or resume - self.next_t > self.max_gap_us:
+                # Nadie tiene datos hasta "resume": esas filas serían todas NaN
+                target = end_t if resume is None else min(-(-resume // self.step_us) * self.step_us, end_t)
+                self._skip(target)
+            else:
+                self._emit_rows(min((end_t - self.next_t) // self.step_us, self.max_frame_rows))
+
+    def _skip(self, target):
+        frame = {"t": np.zeros(0, dtype=np.int64), "devices": list(self.devices),
+                 "data": np.zeros((0, len(self.devices), 3), dtype=np.float32),
+                 "skipped_us": (self.next_t, target)}
+        self.skipped_us += target - self.next_t
+        self.next_t = target
+        for buffer in self.buffers.values():
+            buffer.trim_before(self.next_t, self.max_buffer)
+        self.frames += 1
+        for consumer in self.consumers:
+            consumer(frame)
+
+    def _emit_rows(self, n):
+        grid = self.next_t + np.arange(n, dtype=np.int64) * self.step_us
+        data = np.full((n, len(self.devices), 3), np.nan, dtype=np.float32)
+
+        for d, alias in enumerate(self.devices):
+            buffer = self.buffers[alias]
+            if len(buffer.t) == 0:
+                continue
+            # Solo se interpola dentro del rango cubierto por el dispositivo y sin huecos
+            t_rel = (buffer.t - grid[0]).astype(np.float64)
+            g_rel = (grid - grid[0]).astype(np.float64)
+            for axis in range(3):
+                data[:, d, axis] = np.interp(g_rel, t_rel, buffer.xyz[:, axis], left=np.nan, right=np.nan)
+            right = np.clip(np.searchsorted(buffer.t, grid), 1, len(buffer.t) - 1)
+            if len(buffer.t) > 1:
+                gap = buffer.t[right] - buffer.t[right - 1] > self.max_gap_us
+                data[gap, d, :] = np.nan
+
+        self.next_t = int(grid[-1]) + self.step_us
+        for buffer in self.buffers.values():
+            buffer.trim_before(self.next_t, self.max_buffer)
+
+        frame = {"t": grid, "devices": list(self.devices), "data": data}
+        self.frames += 1
+        for consumer in self.consumers:
+            consumer(frame)
+
+    # Emite todo lo pendiente (fin de la grabación)
+    def flush(self):
+        latest = [b.latest for b in self.buffers.values() if b.latest is not None]
+        if latest and self.next_t is not None:
+            self._emit(max(latest))
+
+    def close(self):
+        self.flush()
@@ -1,104 +1,423 @@
 import asyncio
-import subprocess  # Necesario para borrar claves de sistema en Linux
+import contextlib
+import random
+import struct
+import time
 from functools import partial
-from bleak import BleakClient, BleakScanner
-from modules.data_handler import decode_packet
+from modules.data_handler import decode_packet_arrays
+from modules.pipeline import Pipeline, Stage, POLICY_BLOCK, POLICY_DROP_OLDEST
+from modules.scanner import BackgroundScanner
+from modules.sequencer import Sequencer, is_gap
+from modules.transport import BleakTransport
 
 CHARACTERISTIC_UUID = "0000FF01-0000-1000-8000-00805F9B34FB"
+CREDIT_CHARACTERISTIC_UUID = "0000FF02-0000-1000-8000-00805F9B34FB"
+
+# Control de flujo por créditos (1 crédito = 1 paquete que el ESP32 puede notificar)
+CREDIT_WINDOW = 16  # Paquetes en vuelo como máximo por dispositivo
+CREDIT_BATCH = 4    # Los créditos se devuelven en bloques para no saturar el enlace de escrituras
+CREDIT_GRANT_RETRIES = 4     # Intentos de conceder la ventana inicial al suscribirse
+CREDIT_GRANT_BACKOFF = 0.1   # s antes del segundo intento (se duplica en cada uno)
+
+# Conexiones/suscripciones simultáneas como máximo: un juego completo (6 posiciones) a la
+# vez. Con más intentos simultáneos BlueZ empieza a devolver errores "InProgress".
+MAX_PARALLEL_CONNECTIONS = 6
+
+# Reconexión automática: espera aleatoria entre 0 y min(MAX, BASE * 2^intento) (jitter completo)
+RECONNECT_BACKOFF_BASE = 0.25
+RECONNECT_BACKOFF_MAX = 10.0
+RECONNECT_SCAN_TIMEOUT = 2.0   # Espera a su anuncio (escáner de fondo) por intento: se conecta en cuanto reaparece
+RECONNECT_BOND_RESET = 3       # Intentos fallidos seguidos antes de borrar las claves guardadas
+
+# Etapas del procesado de paquetes: tamaño de cola y política cuando se llena
+DEFAULT_PIPELINE_CONFIG = {
+    "decode": {"maxsize": 256, "policy": POLICY_DROP_OLDEST},
+    "sequence": {"maxsize": 256, "policy": POLICY_BLOCK},
+    "store": {"maxsize": 1024, "policy": POLICY_BLOCK},
+    "print": {"maxsize": 64, "policy": POLICY_DROP_OLDEST},
+}
 
 class BLEManager:
-    def __init__(self):
+    # transport: de dónde salen clientes y escáneres (modules/transport.py); por defecto
+    # Bluetooth real con Bleak, o dispositivos virtuales con SimulatedTransport
+    def __init__(self, pipeline_config=None, transport=None):
+        self.transport = transport or BleakTransport()
         self.connected_devices = {}  # Diccionario: {mac: {client, alias, ...}}
-        self.scanner = BleakScanner()
+        self.scanner = BackgroundScanner(self.transport)  # Escaneo continuo: tabla de candidatos siempre al día
+        self._tasks = set()  # Referencias a tareas lanzadas desde callbacks (evita que el GC las borre)
+        self.sinks = []  # Funciones sink(alias, t_recv_ns, packet) que almacenan/procesan los datos
+        self._raw_publisher = None  # Modo multiproceso: publica los bytes crudos a otro proceso
+        self.capture_log = None  # Log de captura (modules/capture_log.py) de los bytes crudos
+        self.rings = None  # Historial reciente por dispositivo (modules/sample_ring.py), si se usa
+        self.listening = False  # Entre start_listening() y stop_listening()
+        self._reconnect_tasks = {}  # mac -> tarea del supervisor de reconexión
+        self._shutting_down = False
+        self.verbose = True  # Una línea por paquete recibido (el modo servicio la desactiva)
+        self.first_packet = {}  # mac -> t_recv_ns del primer paquete recibido (puesta en marcha)
+        self.tracer = None  # Trazado de latencia por tramo y dispositivo (modules/tracing.py), si se usa
+        self.metrics = None  # Contadores para Prometheus (modules/metrics.py), si se usan
+        self.sequencer = Sequencer()  # Huecos, duplicados y reordenación por dispositivo
 
-    # Callback para manejar apagado/reset de dispositivos => Desconexiones
+        # El callback de Bleak solo encola; decodificar, secuenciar, almacenar e imprimir va en etapas aparte
+        config = {**DEFAULT_PIPELINE_CONFIG, **(pipeline_config or {})}
+        if config["decode"].get("policy", POLICY_BLOCK) == POLICY_BLOCK:
+            # El callback de Bleak no puede esperar: la primera etapa tiene que descartar
+            raise ValueError(f"La etapa 'decode' se alimenta con offer(): no admite la política '{POLICY_BLOCK}'")
+        self.pipeline = Pipeline([
+            # Al salir un paquete de la cola de decodificación se devuelve su crédito
+            Stage("decode", self._decode_stage, on_release=lambda item: self._packet_consumed(item[0]),
+                  **config["decode"]),
+            Stage("sequence", self._sequence_stage, many=True, flush=self.sequencer.flush,
+                  **config["sequence"]),
+            Stage("store", self._store_stage, **config["store"]),
+            Stage("print", self._print_stage, **config["print"]),
+        ])
+
+    # Callback para manejar apagado/reset de dispositivos => Desconexiones.
+    # El dispositivo no se olvida: conserva su alias y un supervisor lo reconecta en segundo plano.
     def _handle_disconnect(self, client):
-        
         mac = client.address
-        alias = "Desconocido"
-
-        if mac in self.connected_devices:
-            # Se guarda el alias antes de borrar
-            alias = self.connected_devices[mac]['alias'] 
-            # Borramos del diccionario de memoria (actualiza el menú)
+        info = self.connected_devices.get(mac)
+        if info is None or info.get('client') is not client:
+            return  # Cliente antiguo de una reconexión anterior
+        if self._shutting_down:
             del self.connected_devices[mac]
+            return
+
+        info['state'] = "reconectando"
+        # Si ya había un hueco abierto (reconexión a medias) se conserva su inicio
+        info.setdefault('disconnected_at', time.monotonic_ns())
+        print(f"\n [AVISO] {info['alias']} ({mac}) se ha desconectado. Reintentando conexión...")
+        self._start_reconnect(mac)
+
+    def _start_reconnect(self, mac):
+        if mac not in self._reconnect_tasks:
+            task = asyncio.get_running_loop().create_task(self._reconnect(mac))
+            self._reconnect_tasks[mac] = task
+            task.add_done_callback(lambda _: self._reconnect_tasks.pop(mac, None))
+
+    # Supervisor de reconexión de un dispositivo: escucha sus anuncios, conecta en cuanto
+    # reaparece, vuelve a suscribirse si se estaba recibiendo y marca el hueco en los datos
+    async def _reconnect(self, mac):
+        info = self.connected_devices[mac]
+        alias = info['alias']
+        attempt = 0
+        failures = 0
+        while not self._shutting_down:
+            try:
+                device = await self.scanner.wait_for(mac, timeout=RECONNECT_SCAN_TIMEOUT)
+                if device is not None:
+                    client = self.transport.client(device, self._handle_disconnect)
+                    await client.connect()
+                    try:
+                        if client.is_connected:
+                            info['client'] = client
+                            info['credits_pending'] = 0
+                            # Sin suscripción el dispositivo seguiría conectado pero mudo
+                            if not self.listening or await self._subscribe(mac, info):
+                                info['state'] = "conectado"
+                                self._mark_gap(alias, info.pop('disconnected_at'), time.monotonic_ns())
+                                if self.metrics is not None:
+                                    self.metrics.reconnected(alias)
+                                print(f"\n [AVISO] {alias} reconectado tras {attempt + 1} intento(s).")
+                                return
+                        raise ConnectionError("no se pudo reanudar la suscripción")
+                    except Exception:
+                        # Se suelta el cliente antes de reintentar: nunca quedan dos conectados
+                        if info.get('client') is client:
+                            info['client'] = None
+                        await client.disconnect()
+                        raise
+                failures += 1 if device is not None else 0
+            except Exception as e:
+                failures += 1
+                print(f"[{alias}] Reconexión fallida: {e}")
+
+            # Varias conexiones fallidas con el dispositivo a la vista: claves obsoletas
+            # (el ESP32 se reinició y perdió el emparejamiento)
+            if failures >= RECONNECT_BOND_RESET:
+                await self._remove_bond(mac)
+                failures = 0
+
+            attempt += 1
+            await asyncio.sleep(random.uniform(0, min(RECONNECT_BACKOFF_MAX, RECONNECT_BACKOFF_BASE * 2 ** attempt)))
+
+    # Borra las claves de emparejamiento guardadas (BlueZ) sin bloquear el bucle asyncio
+    async def _remove_bond(self, mac):
+        await self.transport.remove_bond(mac)
+
+    # Avisa a los sinks que lo admiten (mark_gap) del intervalo sin datos de un dispositivo
+    def _mark_gap(self, alias, t_start_ns, t_end_ns):
+        for sink in self.sinks:
+            mark_gap = getattr(sink, "mark_gap", None)
+            if mark_gap is not None:
+                mark_gap(alias, t_start_ns, t_end_ns)
+        if self.capture_log is not None:
+            self.capture_log.mark_gap(alias, t_start_ns, t_end_ns)
+
+    # Lanza una corrutina desde un callback síncrono de Bleak
+    def _spawn(self, coro):
+        task = asyncio.get_running_loop().create_task(coro)
+        self._tasks.add(task)
+        task.add_done_callback(self._tasks.discard)
+
+    # Concede créditos al dispositivo escribiendo en su característica de control de flujo.
+    # Devuelve False si no se pudo escribir.
+    async def _grant_credits(self, mac, amount):
+        info = self.connected_devices.get(mac)
+        if info is None or info['client'] is None or not info['client'].is_connected:
+            return False
         try:
-            subprocess.run(["bluetoothctl", "remove", mac], check=False, stdout=subprocess.DEVNULL)
+            await info['client'].write_gatt_char(
+                CREDIT_CHARACTERISTIC_UUID, struct.pack('<H', amount), response=False)
+            return True
         except Exception as e:
-            print(f"Error borrando claves de sistema: {e}")
-
-        # Mensaje al usuario
-        print(f"\n" + "!"*50)
-        print(f" [AVISO] {alias} ({mac}) se ha desconectado.")
-        print(f" El dispositivo ha sido eliminado del sistema.")
-        print("!"*50 + "\n")
-        print(">> (Presione Enter para actualizar el menú): ", end="", flush=True)
-
-    # Callback para manejar notificaciones entrantes
-    def _notification_handler(self, alias, sender, data):
-       
-        # Decodificamos el paquete
-        packet = decode_packet(data)
-
-        if packet:           
-            seq = packet['sequence_id']
-            n_samples = len(packet['samples'])
-            
-            # Imprimimos resumen
-            print(f"[{alias}] Paquete #{seq} recibido ({n_samples} muestras)")
+            # Si falla la escritura los créditos se pierden: se devuelven al contador para reintentarlo
+            info['credits_pending'] += amount
+            print(f"[{info['alias']}] Error concediendo créditos: {e}")
+            return False
 
-            # LÓGICA PARA ALMACENAR/PROCESAR DATOS PENDIENTE AQUÍ
+    # Marca un paquete como procesado y devuelve créditos al dispositivo cuando hay suficientes
+    def _packet_consumed(self, mac):
+        info = self.connected_devices.get(mac)
+        if info is None:
+            return
+        info['credits_pending'] += 1
+        if info['credits_pending'] >= CREDIT_BATCH:
+            amount = info['credits_pending']
+            info['credits_pending'] = 0
+            self._spawn(self._grant_credits(mac, amount))
 
+    # Callback para manejar notificaciones entrantes.
+    # Se ejecuta en el bucle asyncio que atiende a todos los dispositivos: solo marca la
+    # hora de llegada y encola los bytes crudos.
+    # "subscription" numera las suscripciones del dispositivo: viaja con cada paquete para
+    # que la etapa de secuenciación sepa cuándo el firmware ha reiniciado sequence_id.
+    def _notification_handler(self, mac, subscription, sender, data):
+        t_recv = time.monotonic_ns()
+        if mac not in self.first_packet:
+            self.first_packet[mac] = t_recv
+        if self.capture_log is not None:
+            self.capture_log.append(self._alias(mac), t_recv, data)
+        if self._raw_publisher is not None:
+            self._raw_publisher(mac, self._alias(mac), t_recv, data)
         else:
-            print(f"[{alias}] Error: Paquete corrupto o tamaño inválido.")
+            self.pipeline.offer((mac, t_recv, data, subscription))
 
-    async def scan_available(self):
-        return await self.scanner.discover()
-
-    async def connect_and_register(self, device, alias):
-        print(f"Conectando a {device.name} ({device.address})...")
-        
-        # Creamos el cliente pasando el callback de desconexión
-        client = BleakClient(
-            device.address, 
-            disconnected_callback=self._handle_disconnect  # Callback de detección de desconexión
-        )
-        
+    # Desvía los paquetes crudos a publisher(mac, alias, t_recv_ns, data) en lugar de al
+    # pipeline local (None = volver al pipeline). Lo usa ProcessHost (modules/multiproc.py).
+    def set_raw_publisher(self, publisher):
+        self._raw_publisher = publisher
+
+    def _alias(self, mac):
+        return self.connected_devices.get(mac, {}).get('alias', mac)
+
+    # Etapa 1: decodificación
+    def _decode_stage(self, item):
+        mac, t_recv, data, subscription = item
+        packet = decode_packet_arrays(data)
+        if packet is None:
+            print(f"[{self._alias(mac)}] Error: Paquete corrupto o tamaño inválido.")
+            if self.metrics is not None:
+                self.metrics.decode_error(self._alias(mac))
+            return None
+        if self.tracer is not None:
+            self.tracer.mark_decoded(packet)
+        if self.metrics is not None:
+            self.metrics.packet(self._alias(mac), packet)
+        return (self._alias(mac), t_recv, packet, subscription)
+
+    # Etapa 2: secuenciación (huecos, duplicados y reordenación; modules/sequencer.py).
+    # Devuelve cero o más elementos (alias, t_recv, registro): paquetes en orden y, antes
+    # del paquete que cierra un hueco, su registro de hueco.
+    def _sequence_stage(self, item):
+        alias, t_recv, packet, subscription = item
+        return self.sequencer.push(alias, t_recv, packet, subscription)
+
+    # Etapa 3: almacenamiento / procesado. Los huecos van a los sinks que los admiten (mark_loss)
+    def _store_stage(self, item):
+        alias, t_recv, packet = item
+        if is_gap(packet):
+            for sink in self.sinks:
+                mark_loss = getattr(sink, "mark_loss", None)
+                if mark_loss is not None:
+                    mark_loss(alias, t_recv, packet)
+            return item
+        for sink in self.sinks:
+            sink(alias, t_recv, packet)
+        if self.tracer is not None:
+            self.tracer.record(alias, t_recv, packet)
+        return item
+
+    # Etapa 4: resumen por consola
+    def _print_stage(self, item):
+        if not self.verbose:
+            return None
+        alias, _, packet = item
+        if is_gap(packet):
+            print(f"[{alias}] Hueco: faltan {packet['packets']} paquetes desde el #{packet['first_seq']} "
+                  f"({packet['samples']} muestras)")
+            return None
+        print(f"[{alias}] Paquete #{packet['sequence_id']} recibido ({len(packet['x'])} muestras)")
+        return None
+
+    # Registra una función sink(alias, t_recv_ns, packet) que recibe cada paquete decodificado
+    def add_sink(self, sink):
+        self.sinks.append(sink)
+
+    # Arranca el escáner en segundo plano (al inicio del programa)
+    async def start_scanning(self):
         try:
-            await client.connect()
-            if client.is_connected:
-                print(f"Conectado exitosamente a {alias}.")
-                
+            await self.scanner.start()
+        except Exception as e:
+            print(f"[Escáner] No se pudo iniciar el escaneo continuo: {e}")
+
+    # Candidatos (modules/scanner.py) con el servicio del acelerómetro aún sin registrar
+    async def scan_available(self):
+        return await self.scanner.candidates(exclude=self.connected_devices)
+
+    # semaphore limita las conexiones simultáneas (connect_many); sin él no se limita nada
+    async def connect_and_register(self, device, alias, semaphore=None):
+        async with semaphore or contextlib.nullcontext():
+            print(f"Conectando a {device.name} ({device.address})...")
+
+            # Creamos el cliente pasando el callback de desconexión
+            client = self.transport.client(
+                device.address,
+                self._handle_disconnect  # Callback de detección de desconexión
+            )
+
+            timings = {}
+            try:
+                # Bleak conecta y hace el descubrimiento GATT aquí: el tiempo incluye ambos
+                start = time.perf_counter()
+                await client.connect()
+                timings["conexión"] = time.perf_counter() - start
+                if not client.is_connected:
+                    print("Fallo al conectar.")
+                    return False
+
+                if client.services.get_characteristic(CHARACTERISTIC_UUID) is None:
+                    print(f"{alias}: no tiene el servicio de acelerómetro.")
+                    await client.disconnect()
+                    return False
+                print(f"Conectado exitosamente a {alias} ({timings['conexión']:.2f} s).")
+
                 # Guardamos en nuestro registro
                 self.connected_devices[device.address] = {
                     "client": client,
                     "alias": alias,
-                    "name": device.name
+                    "name": device.name,
+                    "credits_pending": 0,  # Paquetes procesados cuyos créditos aún no se han devuelto
+                    "timings": timings,    # Duración de cada fase de la puesta en marcha (s)
                 }
                 return True
-            else:
-                print("Fallo al conectar.")
+            except Exception as e:
+                print(f"Error en conexión con {alias}: {e}")
                 return False
-        except Exception as e:
-            print(f"Error en conexión: {e}")
-            return False
 
-    async def start_listening(self):        
-        for mac, info in self.connected_devices.items():
+    # Conecta varios dispositivos a la vez: [(device, alias), ...].
+    # Como mucho max_parallel en curso; el tiempo total se acerca al del más lento.
+    async def connect_many(self, targets, max_parallel=MAX_PARALLEL_CONNECTIONS):
+        semaphore = asyncio.Semaphore(max_parallel)
+        start = time.perf_counter()
+        results = await asyncio.gather(*(self.connect_and_register(device, alias, semaphore)
+                                          for device, alias in targets))
+        self._print_timings(time.perf_counter() - start, ("conexión",))
+        return sum(results)
+
+    # Arranque sin intervención (modo servicio): conecta en paralelo a los dispositivos
+    # conocidos [(mac, alias), ...] en cuanto el escáner ve su anuncio. Los que no aparecen
+    # o fallan quedan registrados y a cargo del supervisor de reconexión.
+    async def connect_known(self, known, scan_timeout, max_parallel=MAX_PARALLEL_CONNECTIONS):
+        semaphore = asyncio.Semaphore(max_parallel)
+        start = time.perf_counter()
+
+        async def connect(mac, alias):
+            device = await self.scanner.wait_for(mac, timeout=scan_timeout)
+            if device is None:
+                print(f"{alias} ({mac}) no está a la vista.")
+                return False
+            return await self.connect_and_register(device, alias, semaphore)
+
+        results = await asyncio.gather(*(connect(mac, alias) for mac, alias in known))
+        self._print_timings(time.perf_counter() - start, ("conexión",))
+        for (mac, alias), ok in zip(known, results):
+            if not ok:
+                print(f" [AVISO] {alias}: se seguirá intentando en segundo plano.")
+                self.connected_devices[mac] = {
+                    "client": None, "alias": alias, "name": None, "credits_pending": 0,
+                    "state": "reconectando", "disconnected_at": time.monotonic_ns(),
+                }
+                self._start_reconnect(mac)
+        return sum(results)
+
+    async def _subscribe(self, mac, info, semaphore=None):
+        async with semaphore or contextlib.nullcontext():
             client = info['client']
-            alias = info['alias'] 
-            
-            if client.is_connected:
+            if client is None or not client.is_connected:
+                return False
+            try:
+                start = time.perf_counter()
+                # Inyectar la MAC y el número de suscripción en el callback para saber de quién es.
+                info['subscription'] = info.get('subscription', 0) + 1
+                if self.capture_log is not None:
+                    self.capture_log.mark_subscribe(info['alias'])
+                await client.start_notify(CHARACTERISTIC_UUID,
+                                          partial(self._notification_handler, mac, info['subscription']))
+
+                # Al suscribirse el ESP32 parte de cero créditos: concedemos la ventana inicial.
+                # Sin ella no llega ningún paquete y _packet_consumed() nunca reintentaría:
+                # se reintenta aquí y, si no hay forma, la suscripción falla.
+                for attempt in range(CREDIT_GRANT_RETRIES):
+                    info['credits_pending'] = 0
+                    if await self._grant_credits(mac, CREDIT_WINDOW):
+                        break
+                    if attempt + 1 < CREDIT_GRANT_RETRIES:
+                        await asyncio.sleep(CREDIT_GRANT_BACKOFF * 2 ** attempt)
+                else:
+                    info['credits_pending'] = 0
+                    raise ConnectionError("no se pudo conceder la ventana inicial de créditos")
+                info.setdefault('timings', {})["suscripción"] = time.perf_counter() - start
+                return True
+            except Exception as e:
+                print(f"Error al suscribirse a {info['alias']}: {e}")
+                return False
+
+    def _print_timings(self, total, phases):
+        print(f"\nPuesta en marcha en {total:.2f} s:")
+        for info in self.connected_devices.values():
+            timings = info.get('timings', {})
+            detail = ", ".join(f"{phase} {timings[phase]:.2f} s" for phase in phases if phase in timings)
+            print(f" * {info['alias']}: {detail or 'sin datos'}")
+
+    async def start_listening(self, max_parallel=MAX_PARALLEL_CONNECTIONS):
+        if self._raw_publisher is None:
+            self.pipeline.start()
+            if self.tracer is not None:
+                self.tracer.start()
+        self.listening = True
+
+        # Todas las suscripciones a la vez: los flujos arrancan casi sincronizados
+        semaphore = asyncio.Semaphore(max_parallel)
+        start = time.perf_counter()
+        devices = list(self.connected_devices.items())
+        results = await asyncio.gather(*(self._subscribe(mac, info, semaphore) for mac, info in devices))
+        self._print_timings(time.perf_counter() - start, ("suscripción",))
+
+        # Conectado pero sin suscripción no enviaría nada: se desconecta para que el
+        # supervisor de reconexión lo vuelva a intentar desde cero
+        for (mac, info), ok in zip(devices, results):
+            client = info['client']
+            if not ok and client is not None and client.is_connected:
+                print(f" [AVISO] {info['alias']} sin suscripción: se reconectará.")
                 try:
-                    # Inyectar el alias en el callback para saber de quién es.
-                    callback_con_alias = partial(self._notification_handler, alias)
-                    
-                    await client.start_notify(CHARACTERISTIC_UUID, callback_con_alias)
-                    
+                    await client.disconnect()
                 except Exception as e:
-                    print(f"Error al suscribirse a {alias}: {e}")
+                    print(f" -> {info['alias']}: error al desconectar ({e})")
 
     async def stop_listening(self):
+        self.listening = False
         # Se hace una copia de los items porque el diccionario cambiará mientras borramos
         items = list(self.connected_devices.items())
 
@@ -107,7 +426,7 @@ class BLEManager:
             alias = info['alias']
             
             # Solo intentamos parar si sigue conectado
-            if client.is_connected:
+            if client is not None and client.is_connected:
                 try:
                     await client.stop_notify(CHARACTERISTIC_UUID)
                 except Exception as e:
@@ -115,10 +434,30 @@ class BLEManager:
             else:
                 print(f" -> {alias} ya estaba desconectado. Omitiendo.")
 
+        # Terminamos de procesar lo que quede en las colas
+        if self._raw_publisher is None:
+            await self.pipeline.stop(drain=True)
+            print("Estado del procesado:")
+            self.pipeline.print_stats()
+            self.sequencer.print_stats()
+            if self.tracer is not None:
+                self.tracer.stop()
+                self.tracer.print_report()
+
     async def disconnect_all(self):
         print("Desconectando todos los dispositivos...")
-        # Hacemos una copia de las keys porque el diccionario cambiará mientras borramos
-        macs = list(self.connected_devices.keys())
-        for mac in macs:
-            await self.connected_devices[mac]['client'].disconnect()
-    
\ No newline at end of file
+        self._shutting_down = True
+        for task in list(self._reconnect_tasks.values()):
+            task.cancel()
+        # Hacemos una copia porque el diccionario cambiará mientras borramos
+        for mac, info in list(self.connected_devices.items()):
+            try:
+                if info['client'] is not None:
+                    await info['client'].disconnect()
+            except Exception as e:
+                print(f" -> {info['alias']}: error al desconectar ({e})")
+            self.connected_devices.pop(mac, None)
+            # Las claves se conservan: una pulsera bloqueada solo acepta a su Raspi y BlueZ
+            # ignora sus anuncios si se borra el dispositivo, así que al reiniciar el servicio
+            # no se podría reconectar. Solo se borran ante claves obsoletas (_reconnect).
+        await self.scanner.stop()
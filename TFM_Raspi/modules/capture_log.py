@@ -0,0 +1,364 @@
+import json
+import os
+import struct
+import threading
+import time
+import zlib
+
+from modules.data_handler import DeviceClock, decode_packet_arrays
+from modules.sequencer import Sequencer, is_gap
+
+LOG_FILE = "capture.log"  # Formato antiguo: un único fichero (equivale al segmento que empieza en 0)
+LOG_SEGMENT_PREFIX = "capture_"
+LOG_SEGMENT_SUFFIX = ".log"
+CHECKPOINT_FILE = "capture.checkpoint"
+
+LOG_SEGMENT_BYTES = 8 * 1024 * 1024  # Se abre un fichero nuevo del log al superar este tamaño
+
+COMMIT_INTERVAL = 0.05      # Segundos máximos entre fsync (commit en grupo)
+COMMIT_BYTES = 64 * 1024    # Se adelanta el commit si se acumula esto en memoria
+CHECKPOINT_INTERVAL = 10.0  # Segundos entre puntos de control del volcado al almacén
+
+# Registro: cabecera + payload + crc32(cabecera + payload)
+# 'I' longitud del payload, 'B' tipo, 'H' id de dispositivo, 'q' recepción (ns, tiempo de pared)
+RECORD_HEADER = struct.Struct("<IBHq")
+RECORD_CRC = struct.Struct("<I")
+RECORD_PACKET = 0  # Payload = bytes crudos de la notificación
+RECORD_DEVICE = 1  # Payload = alias (utf-8); da de alta el id de dispositivo
+RECORD_GAP = 2     # Payload = fin del hueco ('q', ns); la cabecera lleva el inicio
+RECORD_SUBSCRIBE = 3  # Sin payload: nueva suscripción (el firmware reinicia sequence_id)
+GAP_PAYLOAD = struct.Struct("<q")
+
+
+# El log se divide en ficheros capture_<posición>.log, donde <posición> es el offset
+# lógico (bytes desde el inicio del log) de su primer registro. Los offsets del punto de
+# control son lógicos; un registro nunca se reparte entre dos ficheros.
+def _segment_path(session_dir, start):
+    return os.path.join(session_dir, f"{LOG_SEGMENT_PREFIX}{start:016d}{LOG_SEGMENT_SUFFIX}")
+
+
+# [(inicio lógico, ruta)] ordenados; incluye el capture.log antiguo como segmento 0
+def log_segments(session_dir):
+    segments = []
+    for name in os.listdir(session_dir) if os.path.isdir(session_dir) else ():
+        if name == LOG_FILE:
+            segments.append((0, os.path.join(session_dir, name)))
+        elif name.startswith(LOG_SEGMENT_PREFIX) and name.endswith(LOG_SEGMENT_SUFFIX):
+            start = name[len(LOG_SEGMENT_PREFIX):-len(LOG_SEGMENT_SUFFIX)]
+            if start.isdigit():
+                segments.append((int(start), os.path.join(session_dir, name)))
+    return sorted(segments)
+
+
+# Log de captura (write-ahead) en el camino caliente.
+# append() solo serializa en un buffer en memoria; un hilo escribe y hace fsync en
+# grupo cada COMMIT_INTERVAL. Lo confirmado (committed_offset) sobrevive a un corte.
+# Al superar LOG_SEGMENT_BYTES se pasa a un fichero nuevo; replay_into() borra los que
+# quedan enteros por detrás del punto de control.
+class CaptureLog:
+    def __init__(self, session_dir):
+        os.makedirs(session_dir, exist_ok=True)
+        self.session_dir = session_dir
+        segments = log_segments(session_dir)
+        self._segment_start, self.path = segments[-1] if segments else (0, _segment_path(session_dir, 0))
+        self._file = open(self.path, "ab", buffering=0)  # Sin buffer: un fallo no deja bytes pendientes
+
+        # Si se reabre tras un corte se recorta la cola incompleta para que los
+        # registros nuevos no queden detrás de basura (solo el último fichero puede tenerla)
+        if self._file.tell() > 0:
+            valid_end = 0
+            for valid_end, *_ in read_records(self.path):
+                pass
+            self._file.truncate(valid_end)
+            self._file.seek(0, os.SEEK_END)
+        self.committed_offset = self._segment_start + self._file.tell()
+        self._torn = False  # Tras un fallo quedan bytes sin confirmar al final del fichero
+        self.records = 0
+        self.commits = 0
+        self._device_ids = {}
+        self._buffer = bytearray()
+        self._lock = threading.Lock()
+        self._wake = threading.Event()
+        self._closing = False
+        self._thread = threading.Thread(target=self._run, name="tfm-capture-log", daemon=True)
+        self._thread.start()
+
+    def _append_record(self, kind, device_id, t_ns, payload):
+        header = RECORD_HEADER.pack(len(payload), kind, device_id, t_ns)
+        crc = zlib.crc32(payload, zlib.crc32(header))
+        self._buffer += header
+        self._buffer += payload
+        self._buffer += RECORD_CRC.pack(crc)
+
+    def _device_id(self, alias, t_ns):
+        device_id = self._device_ids.get(alias)
+        if device_id is None:
+            device_id = self._device_ids[alias] = len(self._device_ids)
+            self._append_record(RECORD_DEVICE, device_id, t_ns, alias.encode("utf-8"))
+        return device_id
+
+    # Se llama desde el callback de notificación: sin E/S, solo memoria
+    def append(self, alias, t_recv_ns, data):
+        t_ns = DeviceClock.mono_to_wall_ns(t_recv_ns)
+        with self._lock:
+            self._append_record(RECORD_PACKET, self._device_id(alias, t_ns), t_ns, data)
+            self.records += 1
+            if len(self._buffer) >= COMMIT_BYTES:
+                self._wake.set()
+
+    # Hueco por desconexión (tiempos monotónicos en ns, como t_recv)
+    def mark_gap(self, alias, t_start_ns, t_end_ns):
+        t_start = DeviceClock.mono_to_wall_ns(t_start_ns)
+        with self._lock:
+            self._append_record(RECORD_GAP, self._device_id(alias, t_start), t_start,
+                                GAP_PAYLOAD.pack(DeviceClock.mono_to_wall_ns(t_end_ns)))
+
+    # Nueva suscripción de un dispositivo: al volcar, la secuenciación vuelve a empezar en 0
+    def mark_subscribe(self, alias):
+        t_ns = DeviceClock.mono_to_wall_ns(time.monotonic_ns())
+        with self._lock:
+            self._append_record(RECORD_SUBSCRIBE, self._device_id(alias, t_ns), t_ns, b"")
+
+    def _commit(self):
+        with self._lock:
+            buffer, self._buffer = self._buffer, bytearray()
+        if not buffer:
+            return
+        try:
+            if self._torn:
+                self._file.truncate(self.committed_offset - self._segment_start)
+                self._torn = False
+            view = memoryview(buffer)
+            while view:
+                view = view[self._file.write(view):]
+            os.fsync(self._file.fileno())
+        except OSError:
+            # Sin confirmar nada: se recortan los bytes a medias (si no, los registros
+            # siguientes quedarían detrás de basura) y el buffer vuelve delante para reintentar
+            with self._lock:
+                self._buffer[:0] = buffer
+            self._rollback()
+            raise
+        self.committed_offset += len(buffer)
+        self.commits += 1
+        if self.committed_offset - self._segment_start >= LOG_SEGMENT_BYTES:
+            self._rotate()
+
+    # Si tampoco se puede recortar, se recorta antes de escribir en el siguiente commit
+    def _rollback(self):
+        self._torn = True
+        try:
+            self._file.truncate(self.committed_offset - self._segment_start)
+            self._torn = False
+        except OSError as e:
+            print(f"[CaptureLog] No se pudo recortar el log: {e}")
+
+    # Solo entre commits completos: el fichero cerrado termina en un registro entero
+    def _rotate(self):
+        path = _segment_path(self.session_dir, self.committed_offset)
+        new_file = open(path, "ab", buffering=0)
+        _fsync_dir(self.session_dir)
+        self._file.close()
+        self._file, self.path, self._segment_start = new_file, path, self.committed_offset
+
+    def _run(self):
+        while not self._closing:
+            self._wake.wait(COMMIT_INTERVAL)
+            self._wake.clear()
+            try:
+                self._commit()
+            except OSError as e:
+                print(f"[CaptureLog] Error escribiendo el log: {e}")
+
+    def close(self):
+        self._closing = True
+        self._wake.set()
+        self._thread.join()
+        self._commit()
+        self._file.close()
+
+
+def _fsync_dir(path):
+    fd = os.open(path, os.O_RDONLY)
+    try:
+        os.fsync(fd)
+    finally:
+        os.close(fd)
+
+
+# Recorre los registros válidos de un fichero del log entre dos posiciones del fichero.
+# Devuelve tuplas (posición_siguiente, tipo, id_dispositivo, t_ns, payload) y se para
+# en el primer registro incompleto o corrupto (cola de un corte de corriente).
+def read_records(path, start=0, end=None):
+    with open(path, "rb") as f:
+        f.seek(start)
+        data = f.read() if end is None else f.read(end - start)
+
+    pos = 0
+    while pos + RECORD_HEADER.size <= len(data):
+        length, kind, device_id, t_ns = RECORD_HEADER.unpack_from(data, pos)
+        payload_end = pos + RECORD_HEADER.size + length
+        record_end = payload_end + RECORD_CRC.size
+        if record_end > len(data):
+            break
+        (crc,) = RECORD_CRC.unpack_from(data, payload_end)
+        if crc != zlib.crc32(data[pos + RECORD_HEADER.size:payload_end], zlib.crc32(data[pos:pos + RECORD_HEADER.size])):
+            print(f"[CaptureLog] Registro corrupto en la posición {start + pos}: se detiene la lectura")
+            break
+        yield start + record_end, kind, device_id, t_ns, data[pos + RECORD_HEADER.size:payload_end]
+        pos = record_end
+
+
+# Igual que read_records() pero sobre todo el log de la sesión, con posiciones lógicas.
+# Un fichero que no termina en un registro entero (corrupto) detiene la lectura.
+def read_log(session_dir, start=0, end=None):
+    segments = log_segments(session_dir)
+    for k, (segment_start, path) in enumerate(segments):
+        next_start = segments[k + 1][0] if k + 1 < len(segments) else None
+        if next_start is not None and next_start <= start:
+            continue
+        if end is not None and segment_start >= end:
+            return
+        position = max(start, segment_start)
+        for next_offset, *record in read_records(path, position - segment_start,
+                                                 None if end is None else end - segment_start):
+            position = segment_start + next_offset
+            yield (position, *record)
+        if next_start is not None and position != next_start:
+            return
+
+
+# Borra los ficheros del log que quedan enteros antes de "offset" (nunca el último)
+def remove_replayed(session_dir, offset):
+    segments = log_segments(session_dir)
+    for (_, path), (next_start, _) in zip(segments, segments[1:]):
+        if next_start > offset:
+            break
+        os.remove(path)
+
+
+def read_checkpoint(session_dir):
+    path = os.path.join(session_dir, CHECKPOINT_FILE)
+    if not os.path.exists(path):
+        return {"offset": 0, "devices": {}}
+    with open(path, encoding="utf-8") as f:
+        checkpoint = json.load(f)
+    checkpoint["devices"] = {int(k): v for k, v in checkpoint["devices"].items()}
+    return checkpoint
+
+
+# Escritura atómica: fichero temporal + rename
+def write_checkpoint(session_dir, offset, devices):
+    path = os.path.join(session_dir, CHECKPOINT_FILE)
+    tmp = path + ".tmp"
+    with open(tmp, "w", encoding="utf-8") as f:
+        json.dump({"offset": offset, "devices": devices}, f)
+        f.flush()
+        os.fsync(f.fileno())
+    os.replace(tmp, path)
+
+
+# Entrega al almacén la salida del secuenciador: paquetes o huecos (mark_loss, si lo admite)
+def _deliver(store, records):
+    delivered = 0
+    for alias, t_recv, record in records:
+        if is_gap(record):
+            if hasattr(store, "mark_loss"):
+                store.mark_loss(alias, t_recv, record)
+        else:
+            store(alias, t_recv, record)
+            delivered += 1
+    return delivered
+
+
+# Vuelca al almacén los registros del log desde el último punto de control.
+# "store" es un sink(alias, t_recv_ns, packet) con sync() (SessionStoreSink).
+# Los paquetes pasan por un Sequencer (huecos, duplicados, orden) que conviene conservar
+# entre llamadas; lo que retiene se entrega antes del punto de control.
+# Tras un corte se reprocesa desde el punto de control: ningún paquete confirmado en el
+# log se pierde, aunque los del último intervalo pueden quedar duplicados en el almacén.
+# "position" ({"offset", "devices"}, como el punto de control) es lo ya entregado al almacén;
+# quien llama repetidamente lo conserva para que un fallo de sync() no vuelva a entregar
+# lo mismo: el siguiente intento continúa desde ahí y reescribe el punto de control.
+def replay_into(session_dir, store, end=None, sequencer=None, position=None):
+    if not log_segments(session_dir):
+        return 0
+    if position is None:
+        position = read_checkpoint(session_dir)
+    devices = position["devices"]
+    if sequencer is None:
+        sequencer = Sequencer()
+
+    replayed = 0
+    for next_offset, kind, device_id, t_ns, payload in read_log(session_dir, position["offset"], end):
+        alias = devices.get(device_id, f"dispositivo_{device_id}")
+        if kind == RECORD_DEVICE:
+            devices[device_id] = payload.decode("utf-8")
+        elif kind == RECORD_PACKET:
+            packet = decode_packet_arrays(payload)
+            if packet is not None:
+                replayed += _deliver(store, sequencer.push(alias, DeviceClock.wall_to_mono_ns(t_ns), packet))
+        elif kind == RECORD_SUBSCRIBE:
+            replayed += _deliver(store, sequencer.restart(alias))
+        elif kind == RECORD_GAP and hasattr(store, "mark_gap"):
+            (t_end,) = GAP_PAYLOAD.unpack(payload)
+            store.mark_gap(alias, DeviceClock.wall_to_mono_ns(t_ns), DeviceClock.wall_to_mono_ns(t_end))
+        position["offset"] = next_offset
+    replayed += _deliver(store, sequencer.flush())
+
+    # Primero el almacén a disco, después el punto de control y por último el log ya volcado
+    store.sync()
+    write_checkpoint(session_dir, position["offset"], devices)
+    remove_replayed(session_dir, position["offset"])
+    return replayed
+
+
+# Hilo de decodificación diferida: cada CHECKPOINT_INTERVAL pasa al almacén lo que el
+# log ya tiene confirmado en disco. Si falla (p.ej. la SD llena) se avisa y se reintenta
+# en el siguiente intervalo desde el último punto de control.
+class LogReplayer:
+    def __init__(self, capture_log, store, interval=CHECKPOINT_INTERVAL):
+        self.log = capture_log
+        self.store = store
+        self.interval = interval
+        self.session_dir = capture_log.session_dir
+        self.replayed = 0
+        self.errors = 0
+        self.sequencer = Sequencer()
+        self.position = read_checkpoint(self.session_dir)  # Lo ya entregado al almacén
+        self._stop = threading.Event()
+        self._thread = threading.Thread(target=self._run, name="tfm-log-replayer", daemon=True)
+
+    def start(self):
+        self._thread.start()
+
+    def _replay(self):
+        try:
+            self.replayed += replay_into(self.session_dir, self.store, self.log.committed_offset, self.sequencer,
+                                         self.position)
+        except Exception as e:
+            self.errors += 1
+            print(f"[CaptureLog] Error volcando el log al almacén (se reintentará): {e}")
+
+    def _run(self):
+        while not self._stop.wait(self.interval):
+            self._replay()
+
+    # Detiene el hilo y vuelca lo que quede (llamar después de CaptureLog.close())
+    def stop(self):
+        self._stop.set()
+        self._thread.join()
+        self._replay()
+
+
+# Recuperación manual de una sesión tras un corte:
+#   python -m modules.capture_log data/raw/<sesión>
+if __name__ == "__main__":
+    import sys
+    from modules.session_store import SessionStoreSink
+
+    session_dir = os.path.abspath(sys.argv[1])
+    store = SessionStoreSink(root=os.path.dirname(session_dir), session=os.path.basename(session_dir))
+    n = replay_into(session_dir, store)
+    store.close()
+    print(f"Recuperados {n} paquetes desde el punto de control en {session_dir}")
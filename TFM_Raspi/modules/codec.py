@@ -0,0 +1,168 @@
+import struct
+import zlib
+
+import numpy as np
+
+# Códec de almacenamiento para sesiones grabadas.
+# Cada columna se transforma según su estructura antes del compresor genérico:
+#   - t   (int64, µs): delta-de-delta. Con muestreo regular casi todo queda en 0.
+#   - x/y/z (int16): predicción lineal (orden 1 o 2, el que deje residuos menores).
+#   - seq (uint32): delta (se repite dentro del paquete y sube de 1 en 1).
+# Los residuos pasan a zigzag (enteros sin signo pequeños), se guardan con el ancho
+# mínimo de byte que los contiene y se reordenan por planos de bytes antes del back end.
+
+# Back ends disponibles (el más rápido que esté instalado)
+BACKEND_ZLIB, BACKEND_LZ4, BACKEND_ZSTD = 0, 1, 2
+_BACKENDS = {BACKEND_ZLIB: (lambda b: zlib.compress(b, 1), zlib.decompress)}
+try:
+    import lz4.frame
+    _BACKENDS[BACKEND_LZ4] = (lz4.frame.compress, lz4.frame.decompress)
+except ImportError:
+    pass
+try:
+    import zstandard
+    _BACKENDS[BACKEND_ZSTD] = (zstandard.ZstdCompressor(level=3).compress,
+                               zstandard.ZstdDecompressor().decompress)
+except ImportError:
+    pass
+DEFAULT_BACKEND = max(_BACKENDS, key=lambda b: (b == BACKEND_ZSTD, b == BACKEND_LZ4))
+
+# Columnas y orden de predicción candidato (None = se elige por bloque)
+COLUMNS = {
+    "t": (np.dtype("<i8"), 2),
+    "x": (np.dtype("<i2"), None),
+    "y": (np.dtype("<i2"), None),
+    "z": (np.dtype("<i2"), None),
+    "seq": (np.dtype("<u4"), 1),
+}
+
+BLOCK_ROWS = 4096
+_MAGIC = b"TFMC"
+_VERSION = 1
+_BLOCK_HEADER = struct.Struct("<4sBBII")  # magic, versión, back end, filas, bytes comprimidos
+_COLUMN_HEADER = struct.Struct("<BBI")    # orden de predicción, ancho en bytes, bytes
+
+
+def available_backends():
+    return sorted(_BACKENDS)
+
+
+def _residuals(values, order):
+    r = values.astype(np.int64)
+    for _ in range(order):
+        r = np.diff(r, prepend=np.int64(0))
+    return r
+
+
+def _zigzag(r):
+    return ((r << 1) ^ (r >> 63)).view(np.uint64)
+
+
+def _unzigzag(u):
+    return (u >> np.uint64(1)).view(np.int64) ^ -(u & np.uint64(1)).view(np.int64)
+
+
+def _encode_column(values, order):
+    if order is None:
+        # Orden 1 frente a orden 2: se queda con el de residuos más pequeños
+        candidates = [(np.abs(r).sum(), k, r) for k, r in ((1, _residuals(values, 1)), (2, _residuals(values, 2)))]
+        _, order, r = min(candidates, key=lambda c: c[0])
+    else:
+        r = _residuals(values, order)
+    u = _zigzag(r)
+    top = int(u.max()) if len(u) else 0
+    width = 1 if top < 1 << 8 else 2 if top < 1 << 16 else 4 if top < 1 << 32 else 8
+    narrow = u.astype(np.dtype(f"<u{width}"))
+    # Planos de bytes: primero todos los bytes bajos, luego los altos (los altos son casi todos 0)
+    planes = narrow.view(np.uint8).reshape(-1, width).T.tobytes()
+    return _COLUMN_HEADER.pack(order, width, len(planes)) + planes
+
+
+def _decode_column(buffer, offset, rows, dtype):
+    order, width, size = _COLUMN_HEADER.unpack_from(buffer, offset)
+    offset += _COLUMN_HEADER.size
+    planes = np.frombuffer(buffer, dtype=np.uint8, count=size, offset=offset)
+    narrow = np.ascontiguousarray(planes.reshape(width, rows).T).view(np.dtype(f"<u{width}")).ravel()
+    r = _unzigzag(narrow.astype(np.uint64))
+    for _ in range(order):
+        r = np.cumsum(r)
+    return r.astype(dtype), offset + size
+
+
+# Codifica un bloque {columna: array} (todas con la misma longitud) a bytes
+def encode_block(columns, backend=None):
+    backend = DEFAULT_BACKEND if backend is None else backend
+    rows = len(columns["t"])
+    payload = b"".join(_encode_column(np.asarray(columns[name]), order) for name, (_, order) in COLUMNS.items())
+    compressed = _BACKENDS[backend][0](payload)
+    return _BLOCK_HEADER.pack(_MAGIC, _VERSION, backend, rows, len(compressed)) + compressed
+
+
+# Decodifica un bloque. Devuelve ({columna: array}, bytes consumidos)
+def decode_block(buffer, offset=0):
+    magic, version, backend, rows, size = _BLOCK_HEADER.unpack_from(buffer, offset)
+    if magic != _MAGIC or version != _VERSION:
+        raise ValueError("Bloque comprimido no válido")
+    if backend not in _BACKENDS:
+        raise ValueError(f"Back end de compresión {backend} no instalado")
+    start = offset + _BLOCK_HEADER.size
+    payload = _BACKENDS[backend][1](bytes(buffer[start:start + size]))
+
+    columns = {}
+    pos = 0
+    for name, (dtype, _) in COLUMNS.items():
+        columns[name], pos = _decode_column(payload, pos, rows, dtype)
+    return columns, _BLOCK_HEADER.size + size
+
+
+# Codificador en streaming: acumula filas y escribe un bloque cada "block_rows"
+class StreamEncoder:
+    def __init__(self, fileobj, block_rows=BLOCK_ROWS, backend=None):
+        self.fileobj = fileobj
+        self.block_rows = block_rows
+        self.backend = backend
+        self.pending = {name: [] for name in COLUMNS}
+        self.pending_rows = 0
+        self.raw_bytes = 0
+        self.encoded_bytes = 0
+
+    def write(self, t, x, y, z, seq):
+        for name, values in (("t", t), ("x", x), ("y", y), ("z", z), ("seq", seq)):
+            self.pending[name].append(np.asarray(values))
+        self.pending_rows += len(t)
+        while self.pending_rows >= self.block_rows:
+            self._emit(self.block_rows)
+
+    def _emit(self, rows):
+        joined = {name: np.concatenate(parts) for name, parts in self.pending.items()}
+        block = {name: values[:rows] for name, values in joined.items()}
+        self.pending = {name: [values[rows:]] for name, values in joined.items()}
+        self.pending_rows -= rows
+
+        data = encode_block(block, self.backend)
+        self.fileobj.write(data)
+        self.raw_bytes += sum(values.nbytes for values in block.values())
+        self.encoded_bytes += len(data)
+
+    # Escribe el último bloque (incompleto)
+    def close(self):
+        if self.pending_rows:
+            self._emit(self.pending_rows)
+
+    @property
+    def ratio(self):
+        return self.raw_bytes / self.encoded_bytes if self.encoded_bytes else 0.0
+
+
+# Decodificador en streaming: devuelve los bloques de un fichero uno a uno
+def iter_blocks(fileobj):
+    while True:
+        header = fileobj.read(_BLOCK_HEADER.size)
+        if len(header) < _BLOCK_HEADER.size:
+            return
+        size = _BLOCK_HEADER.unpack(header)[4]
+        body = fileobj.read(size)
+        if len(body) < size:
+            return # Bloque final truncado
+        columns, _ = decode_block(header + body)
+        yield columns
@@ -1,58 +1,369 @@
-import struct # Para desempaquetar datos binarios
+import time
+from functools import lru_cache, partial
 
-# Constante de los dispositivos ESP32. Número de muestras por paquete
-SAMPLES_PER_PACKET = 35
+import numpy as np # Para interpretar los datos binarios con dtypes estructurados
 
-# Función para decodificar un paquete de datos binarios recibido por BLE
-def decode_packet(data):
-    
-    # El paquete debe tener exactamente 218 bytes
-    # 4 (seq) + 4 (time) + 35 * (2(x)+2(y)+2(z)) = 218
-    expected_size = 4 + 4 + (SAMPLES_PER_PACKET * 6)
-    
-    # Comprobamos el tamaño del paquete (si se perdieron datos por el camino)
+# Formato del paquete (generado desde protocol/accel_packet.json, no editar a mano)
+from modules.packet_schema import (
+    BITFIELDS, CH_XYZ, ENC_RAW_I16, FORMAT_VERSION, HEADER_DTYPE, HEADER_V1_DTYPE, LEGACY_PACKET_DTYPE, SAMPLE_DTYPE
+)
+
+# Firmware antiguo (versión 0): paquete sin cabecera de formato, siempre 218 bytes
+LEGACY_SAMPLE_RATE = 100
+LEGACY_PACKET_SIZE = LEGACY_PACKET_DTYPE.itemsize
+
+# Cabecera autodescriptiva por versión (>= 1). La versión 2 añade notify_offset_ms al final
+HEADER_DTYPES = {1: HEADER_V1_DTYPE, FORMAT_VERSION: HEADER_DTYPE}
+
+# Código de fondo de escala -> g
+FULL_SCALE_RANGES_G = (2, 4, 8, 16)
+
+# Orden de los canales dentro de la máscara (bit 0 = X, bit 1 = Y, bit 2 = Z)
+CHANNEL_NAMES = SAMPLE_DTYPE.names
+
+
+# Extrae un subcampo de bits de la cabecera (p.ej. _bits(fmt, "format", "version"))
+def _bits(value, field, name):
+    shift, mask = BITFIELDS[field][name]
+    return (int(value) >> shift) & mask
+
+# dtype de una muestra con solo los canales presentes en la máscara
+def _sample_dtype(channel_mask):
+    if channel_mask == CH_XYZ:
+        return SAMPLE_DTYPE
+    channels = [name for bit, name in enumerate(CHANNEL_NAMES) if channel_mask & (1 << bit)]
+    return np.dtype([(name, SAMPLE_DTYPE[name]) for name in channels])
+
+
+# Decodifica las muestras int16 intercaladas de los canales indicados en la máscara
+def _decode_raw_i16(data, offset, sample_count, channel_mask):
+    dtype = _sample_dtype(channel_mask)
+    raw_samples = np.frombuffer(data, dtype=dtype, count=sample_count, offset=offset)
+    return [dict(zip(dtype.names, values)) for values in raw_samples.tolist()]
+
+# Decodificadores de muestras por codificación
+_SAMPLE_DECODERS = {
+    ENC_RAW_I16: _decode_raw_i16,
+}
+
+
+# Paquetes de firmware antiguo: layout fijo 'seq, time, 35 x (x,y,z)'
+def _decode_legacy(data):
+    packet = np.frombuffer(data, dtype=LEGACY_PACKET_DTYPE, count=1)[0]
+    return {
+        "version": 0,
+        "encoding": ENC_RAW_I16,
+        "channel_mask": CH_XYZ,
+        "sample_rate": LEGACY_SAMPLE_RATE,
+        "range_g": None, # El firmware antiguo no lo informa
+        "sequence_id": int(packet["sequence_id"]),
+        "timestamp_start": int(packet["timestamp_start"]),
+        "samples": [dict(zip(CHANNEL_NAMES, values)) for values in packet["samples"].tolist()]
+    }
+
+# Paquetes versión >= 1: cabecera autodescriptiva + muestras
+def _decode_header(data, header_dtype):
+    header_size = header_dtype.itemsize
+    if len(data) < header_size:
+        print(f"Paquete demasiado corto: Recibido {len(data)}, cabecera de {header_size}")
+        return None
+
+    header = np.frombuffer(data, dtype=header_dtype, count=1)[0]
+    encoding = _bits(header["format"], "format", "encoding")
+    channel_mask = _bits(header["channels"], "channels", "mask")
+    range_code = _bits(header["channels"], "channels", "range")
+    sample_count = int(header["sample_count"])
+
+    decoder = _SAMPLE_DECODERS.get(encoding)
+    if decoder is None:
+        print(f"Codificación de paquete desconocida: {encoding}")
+        return None
+
+    # El tamaño se deduce de la cabecera: no hay que adivinarlo
+    expected_size = header_size + sample_count * _sample_dtype(channel_mask).itemsize
     if len(data) != expected_size:
         print(f"Tamaño de paquete incorrecto: Recibido {len(data)}, Esperado {expected_size}")
-        return None # No se devolve nada si el tamaño es incorrecto
-
-    # Desempaquetamiento la Cabecera (8 bytes)
-    # '<' = Little Endian (Estándar en ESP32)
-    # 'I' = Unsigned Int (4 bytes)
-    header_format = '<II' 
-    # Calculo del tamaño de la cabecera
-    header_size = struct.calcsize(header_format)
-    
-    # Obtenemos los valores para el ID de secuencia y timestamp
-    sequence_id, timestamp = struct.unpack(header_format, data[:header_size])
-
-    # Obtenemos las muetsras de lo que queda del paquete
-    raw_samples = data[header_size:]
-    # Lista para guardar las muestras decodificadas
-    samples = []
-
-    # Desempaquetamiento de las muestras (6 bytes cada una: X,Y,Z)
-    # Iteramos cada 6 bytes (X, Y, Z son int16 = 'h')
-    # 'h' = short (2 bytes con signo)
-    sample_format = '<hhh'
-    
-    for i in range(SAMPLES_PER_PACKET):
-        start = i * 6
-        end = start + 6
-        chunk = raw_samples[start:end]
-        
-        # Desempaquetamos los valores X, Y, Z en numeros python
-        x, y, z = struct.unpack(sample_format, chunk)
-        
-        # Se meten las muestras en la lista
-        samples.append({
-            "x": x,
-            "y": y,
-            "z": z
-        })
-
-    # Se devuelve toda la información del paquete decodificada
+        return None
+
     return {
-        "sequence_id": sequence_id,
-        "timestamp_start": timestamp,
-        "samples": samples
-    }
\ No newline at end of file
+        "version": _bits(header["format"], "format", "version"),
+        "encoding": encoding,
+        "channel_mask": channel_mask,
+        "sample_rate": int(header["sample_rate_hz"]),
+        "range_g": FULL_SCALE_RANGES_G[range_code] if range_code < len(FULL_SCALE_RANGES_G) else None,
+        "sequence_id": int(header["sequence_id"]),
+        "timestamp_start": int(header["timestamp_start"]),
+        "notify_offset_ms": _notify_offset(header),
+        "samples": decoder(data, header_size, sample_count, channel_mask)
+    }
+
+# ms entre la primera muestra y la entrega a NimBLE (None si la versión no lo lleva)
+def _notify_offset(header):
+    if "notify_offset_ms" not in header.dtype.names:
+        return None
+    return int(header["notify_offset_ms"])
+
+# Decodificadores por versión de formato
+_PACKET_DECODERS = {
+    version: partial(_decode_header, header_dtype=dtype) for version, dtype in HEADER_DTYPES.items()
+}
+
+# Versiones que se saben decodificar (el escáner ignora los anuncios de las demás)
+SUPPORTED_VERSIONS = (0, *_PACKET_DECODERS)
+
+
+# Función para decodificar un paquete de datos binarios recibido por BLE
+def decode_packet(data):
+
+    # Firmware antiguo: no lleva cabecera, se reconoce por su tamaño fijo
+    # (ningún paquete con cabecera mide 218 bytes: 13 o 15 + múltiplo de 2 siempre es impar)
+    if len(data) == LEGACY_PACKET_SIZE:
+        return _decode_legacy(data)
+
+    if len(data) == 0:
+        print("Paquete vacío")
+        return None
+
+    # El primer byte indica la versión del formato
+    version = _bits(data[0], "format", "version")
+    decoder = _PACKET_DECODERS.get(version)
+    if decoder is None:
+        print(f"Versión de paquete no soportada: {version}")
+        return None
+
+    return decoder(data)
+
+
+# ------------------ DECODIFICACIÓN VECTORIZADA (NumPy) ------------------
+# Evitan crear un diccionario por muestra: devuelven arrays int16 contiguos por eje.
+# Solo soportan el caso habitual (codificación int16 con X, Y y Z); el resto se descarta
+# y se cuenta en "errors" (para esos paquetes sigue disponible decode_packet()).
+
+# Versión de formato de un paquete con cabecera (4 bits altos del primer byte)
+def _version(data):
+    return _bits(data[0], "format", "version") if len(data) else None
+
+# dtype completo (cabecera + muestras) de un paquete de "size" bytes y versión "version"
+@lru_cache(maxsize=64)
+def _packet_dtype(size, version):
+    if size == LEGACY_PACKET_SIZE:
+        return LEGACY_PACKET_DTYPE
+    header_dtype = HEADER_DTYPES.get(version)
+    if header_dtype is None:
+        return None
+    n_samples, rest = divmod(size - header_dtype.itemsize, SAMPLE_DTYPE.itemsize)
+    if size < header_dtype.itemsize or rest != 0:
+        return None
+    return np.dtype([("header", header_dtype), ("samples", SAMPLE_DTYPE, (n_samples,))])
+
+# Separa un buffer con varios paquetes (v1 o v2) concatenados usando el nº de muestras de cada cabecera
+def _split_buffer(buffer):
+    view = memoryview(buffer).cast("B")
+    count_offset = HEADER_DTYPE.fields["sample_count"][1]  # Misma posición en todas las versiones
+    packets = []
+    offset = 0
+    while offset < len(view):
+        header_dtype = HEADER_DTYPES.get(_version(view[offset:offset + 1]))
+        if header_dtype is None or offset + header_dtype.itemsize > len(view):
+            break
+        size = header_dtype.itemsize + view[offset + count_offset] * SAMPLE_DTYPE.itemsize
+        packets.append(view[offset:offset + size])
+        offset += size
+    if offset != len(view):
+        print(f"Buffer de paquetes truncado: sobran {len(view) - offset} bytes")
+    return packets
+
+
+# Decodifica muchos paquetes en una sola llamada.
+# "packets" puede ser una lista de paquetes (bytes) o un buffer con paquetes v1/v2 concatenados.
+# Devuelve arrays por paquete (sequence_id, timestamp_start, sample_rate, sample_count, offsets)
+# y arrays int16 contiguos x, y, z con todas las muestras; las del paquete i están en
+# x[offsets[i]:offsets[i + 1]]. Se respeta el orden de entrada.
+def decode_packets(packets):
+    if isinstance(packets, (bytes, bytearray, memoryview)):
+        packets = _split_buffer(packets)
+
+    # Agrupamos por tamaño y versión: cada grupo se interpreta con un único np.frombuffer
+    groups = {}
+    for i, data in enumerate(packets):
+        groups.setdefault((len(data), _version(data)), []).append(i)
+
+    n_packets = len(packets)
+    valid = np.zeros(n_packets, dtype=bool)
+    version = np.zeros(n_packets, dtype=np.uint8)
+    sample_rate = np.zeros(n_packets, dtype=np.uint16)
+    sequence_id = np.zeros(n_packets, dtype=np.uint32)
+    timestamp_start = np.zeros(n_packets, dtype=np.uint32)
+    sample_count = np.zeros(n_packets, dtype=np.int64)
+    decoded = []
+
+    for (size, pkt_version), indices in groups.items():
+        dtype = _packet_dtype(size, pkt_version)
+        if dtype is None:
+            continue
+        indices = np.asarray(indices)
+        arr = np.frombuffer(b"".join(packets[i] for i in indices), dtype=dtype)
+
+        if dtype is LEGACY_PACKET_DTYPE:
+            ok = np.ones(len(arr), dtype=bool)
+            version[indices] = 0
+            sample_rate[indices] = LEGACY_SAMPLE_RATE
+            sequence_id[indices] = arr["sequence_id"]
+            timestamp_start[indices] = arr["timestamp_start"]
+        else:
+            header = arr["header"]
+            shift, mask = BITFIELDS["format"]["encoding"]
+            ok = ((header["format"] >> shift) & mask) == ENC_RAW_I16
+            shift, mask = BITFIELDS["channels"]["mask"]
+            ok &= ((header["channels"] >> shift) & mask) == CH_XYZ
+            ok &= header["sample_count"] == dtype["samples"].shape[0]
+            version[indices] = pkt_version
+            sample_rate[indices] = header["sample_rate_hz"]
+            sequence_id[indices] = header["sequence_id"]
+            timestamp_start[indices] = header["timestamp_start"]
+
+        valid[indices] = ok
+        sample_count[indices[ok]] = dtype["samples"].shape[0]
+        decoded.append((indices[ok], arr["samples"][ok]))
+
+    offsets = np.zeros(n_packets + 1, dtype=np.int64)
+    np.cumsum(sample_count, out=offsets[1:])
+    total = int(offsets[-1])
+    axes = {name: np.empty(total, dtype=np.int16) for name in CHANNEL_NAMES}
+
+    # Cada grupo copia sus muestras a su posición final (orden de entrada)
+    for indices, samples in decoded:
+        if len(indices) == 0:
+            continue
+        positions = offsets[indices][:, None] + np.arange(samples.shape[1])
+        for name in CHANNEL_NAMES:
+            axes[name][positions] = samples[name]
+
+    return {
+        "valid": valid,
+        "errors": int(n_packets - valid.sum()),
+        "version": version[valid],
+        "sample_rate": sample_rate[valid],
+        "sequence_id": sequence_id[valid],
+        "timestamp_start": timestamp_start[valid],
+        "sample_count": sample_count[valid],
+        "offsets": np.concatenate(([0], np.cumsum(sample_count[valid]))),
+        "x": axes["x"],
+        "y": axes["y"],
+        "z": axes["z"],
+    }
+
+
+# Versión vectorizada de decode_packet(): mismos campos de cabecera, pero las muestras
+# se devuelven como tres arrays int16 contiguos (x, y, z) en lugar de una lista de dicts
+def decode_packet_arrays(data):
+    version = _version(data)
+    dtype = _packet_dtype(len(data), version)
+    if dtype is None:
+        print(f"Tamaño o versión de paquete incorrectos: Recibido {len(data)} bytes, versión {version}")
+        return None
+
+    packet = np.frombuffer(data, dtype=dtype, count=1)[0]
+
+    if dtype is LEGACY_PACKET_DTYPE:
+        version, sample_rate, range_g, notify_offset = 0, LEGACY_SAMPLE_RATE, None, None
+        sequence_id, timestamp = packet["sequence_id"], packet["timestamp_start"]
+    else:
+        header = packet["header"]
+        if (_bits(header["format"], "format", "encoding") != ENC_RAW_I16
+                or _bits(header["channels"], "channels", "mask") != CH_XYZ
+                or header["sample_count"] != dtype["samples"].shape[0]):
+            print("Paquete no soportado por el decodificador vectorizado")
+            return None
+        range_code = _bits(header["channels"], "channels", "range")
+        range_g = FULL_SCALE_RANGES_G[range_code] if range_code < len(FULL_SCALE_RANGES_G) else None
+        sample_rate = header["sample_rate_hz"]
+        sequence_id, timestamp = header["sequence_id"], header["timestamp_start"]
+        notify_offset = _notify_offset(header)
+
+    samples = packet["samples"]
+    return {
+        "version": version,
+        "sample_rate": int(sample_rate),
+        "range_g": range_g,
+        "sequence_id": int(sequence_id),
+        "timestamp_start": int(timestamp),
+        "notify_offset_ms": notify_offset,
+        # Cada eje se copia a su propio array contiguo (en el paquete van intercalados)
+        "x": np.ascontiguousarray(samples["x"]),
+        "y": np.ascontiguousarray(samples["y"]),
+        "z": np.ascontiguousarray(samples["z"]),
+    }
+
+
+# Marca de tiempo (µs, reloj del dispositivo) de cada muestra de un paquete decodificado.
+# El paquete solo trae la de la primera muestra; el resto se deduce de la frecuencia.
+def sample_timestamps_us(packet):
+    n_samples = len(packet["x"])
+    step_us = 1_000_000 / packet["sample_rate"]
+    return packet["timestamp_start"] * 1000 + (np.arange(n_samples) * step_us).astype(np.int64)
+
+
+# Traduce el reloj de un dispositivo (µs desde su suscripción) a tiempo de pared de la
+# Raspi (µs desde epoch), común a todos los dispositivos.
+# offset = recepción - tiempo del dispositivo; el paquete que menos tarda en llegar da
+# la mejor estimación, así que se sigue el mínimo (filtro de retardo mínimo). Para
+# seguir la deriva entre relojes el offset puede subir lentamente (DRIFT_PPM).
+# El filtro trabaja en tiempo monotónico y el paso a tiempo de pared se hace al final con
+# el desfase monotónico -> pared vigente: la Raspi no tiene RTC y NTP puede corregir la
+# hora (días) después de arrancar; se vuelve a medir cada WALL_REFRESH_NS.
+class DeviceClock:
+    DRIFT_PPM = 100
+    WALL_REFRESH_NS = 1_000_000_000
+    # Un salto mayor que este (µs) hacia arriba es un cambio de hora en marcas guardadas
+    # como tiempo de pared (log de captura), no retardo: ni la retención del dispositivo
+    # (16 paquetes) se acerca
+    CLOCK_STEP_US = 60_000_000
+    _mono_to_wall_ns = time.time_ns() - time.monotonic_ns()
+    _wall_measured_ns = time.monotonic_ns()
+
+    def __init__(self):
+        self.offset_us = None
+        self._last_device_us = None
+        self._last_recv_us = None
+
+    # Desfase monotónico -> pared actual (se vuelve a medir como mucho una vez por segundo)
+    @classmethod
+    def _wall_offset_ns(cls):
+        now = time.monotonic_ns()
+        if now - cls._wall_measured_ns >= cls.WALL_REFRESH_NS:
+            cls._mono_to_wall_ns = time.time_ns() - time.monotonic_ns()
+            cls._wall_measured_ns = now
+        return cls._mono_to_wall_ns
+
+    # Tiempo de pared (µs) de una marca time.monotonic_ns() de recepción
+    @classmethod
+    def wall_us(cls, t_recv_ns):
+        return (t_recv_ns + cls._wall_offset_ns()) // 1000
+
+    # Conversión entre marcas monotonic_ns() y tiempo de pared en ns (para guardarlas en disco)
+    @classmethod
+    def mono_to_wall_ns(cls, t_recv_ns):
+        return t_recv_ns + cls._wall_offset_ns()
+
+    @classmethod
+    def wall_to_mono_ns(cls, t_wall_ns):
+        return t_wall_ns - cls._wall_offset_ns()
+
+    # Convierte las marcas de un paquete (sample_timestamps_us) usando su hora de llegada
+    def to_host_us(self, device_t_us, t_recv_ns):
+        recv_us = t_recv_ns // 1000
+        last_device_us = int(device_t_us[-1])
+        candidate = recv_us - last_device_us
+
+        if self.offset_us is None or last_device_us < self._last_device_us \
+                or candidate - self.offset_us > self.CLOCK_STEP_US:
+            # Primer paquete, el dispositivo reinició su reloj (nueva suscripción) o cambio de hora
+            self.offset_us = candidate
+        else:
+            relax = (recv_us - self._last_recv_us) * self.DRIFT_PPM // 1_000_000
+            self.offset_us = min(self.offset_us + relax, candidate)
+
+        self._last_device_us = last_device_us
+        self._last_recv_us = recv_us
+        return device_t_us + self.offset_us + self._wall_offset_ns() // 1000
@@ -0,0 +1,219 @@
+import threading
+import time
+from functools import lru_cache
+
+import numpy as np
+
+from modules.data_handler import sample_timestamps_us
+from modules.sample_ring import SampleRing
+
+# Features por ventana deslizante y dispositivo para los modelos de actividad.
+# Los momentos (media, varianza, RMS, jerk, correlación entre ejes) salen de sumas
+# prefijo: con P_k = suma de las k primeras muestras, la suma de cualquier ventana es
+# P_fin - P_inicio, O(1) por ventana y calculado para todo el paquete de una vez.
+# Las sumas son enteras (int64 sobre muestras int16): exactas, sin deriva numérica
+# aunque la captura dure días (y la resta sigue siendo correcta aunque P desborde),
+# así que no hace falta Welford.
+# La energía por bandas sale de una FFT por lotes (varias ventanas en una llamada).
+
+WINDOW_SECONDS = 2.0
+HOP_SECONDS = 0.5
+RATE_HZ = 100
+BANDS_HZ = ((0.5, 3.0), (3.0, 8.0), (8.0, 20.0))  # Postura/marcha, movimiento rápido, temblor/ruido
+BATCH_WINDOWS = 64       # Ventanas por FFT: una FFT por ventana es más lenta que recalcular desde cero
+BATCH_MAX_DELAY = 0.5    # s máximos que una ventana espera a completar el lote (uso fuera de línea;
+                         # la inferencia en tiempo real lo deriva de su presupuesto de latencia)
+
+AXES = ("x", "y", "z")
+_PAIRS = ((0, 1), (0, 2), (1, 2))
+
+
+def feature_names(bands=BANDS_HZ):
+    names = []
+    for stat in ("mean", "var", "rms", "jerk"):
+        names += [f"{axis}_{stat}" for axis in AXES]
+    names += [f"corr_{AXES[a]}{AXES[b]}" for a, b in _PAIRS]
+    for low, high in bands:
+        names += [f"{axis}_band_{low:g}_{high:g}" for axis in AXES]
+    return names
+
+
+@lru_cache(maxsize=8)
+def _hann(n):
+    return np.hanning(n).astype(np.float32)
+
+
+# Matriz (frecuencias, bandas) con 1 donde la frecuencia cae en la banda
+@lru_cache(maxsize=8)
+def _band_matrix(n, rate, bands):
+    freqs = np.fft.rfftfreq(n, 1.0 / rate)
+    return np.stack([(freqs >= low) & (freqs < high) for low, high in bands], axis=1).astype(np.float64)
+
+
+# Energía por bandas de un lote de ventanas (B, N, 3): sin media, ventana de Hann y rfft.
+# Resultado (B, bandas * 3): [banda0 x,y,z, banda1 x,y,z, ...]
+def band_energy(windows, rate=RATE_HZ, bands=BANDS_HZ):
+    b, n, _ = windows.shape
+    centered = windows - windows.mean(axis=1, keepdims=True)
+    spectrum = np.fft.rfft(centered * _hann(n)[None, :, None], axis=1)
+    power = (spectrum.real ** 2 + spectrum.imag ** 2) / n
+    # Suma por bandas con un solo producto de matrices (en vez de una máscara por banda)
+    return (power.transpose(0, 2, 1) @ _band_matrix(n, rate, tuple(bands))).transpose(0, 2, 1).reshape(b, -1)
+
+
+# Por muestra: x,y,z | x²,y²,z² | xy,xz,yz | |Δx|,|Δy|,|Δz|  (sus sumas dan los momentos)
+_A, _B = [a for a, _ in _PAIRS], [b for _, b in _PAIRS]
+
+
+def _per_sample(v, previous):
+    diffs = np.abs(np.diff(np.vstack((previous, v)), axis=0)) if previous is not None \
+        else np.abs(np.diff(v, axis=0, prepend=v[:1]))
+    return np.hstack((v, v * v, v[:, _A] * v[:, _B], diffs))
+
+
+# Momentos de k ventanas a partir de sus sumas (k, 12); jerk con n-1 diferencias
+def _moments(sums, count, rate):
+    s1, s2, cross, jerk = sums[:, 0:3], sums[:, 3:6], sums[:, 6:9], sums[:, 9:12]
+    mean = s1 / count
+    var = np.maximum(s2 / count - mean ** 2, 0.0)
+    rms = np.sqrt(s2 / count)
+    jerk_rate = jerk / max(count - 1, 1) * rate
+    with np.errstate(invalid="ignore", divide="ignore"):
+        corr = (cross / count - mean[:, _A] * mean[:, _B]) / np.sqrt(var[:, _A] * var[:, _B])
+    return np.hstack((mean, var, rms, jerk_rate, np.nan_to_num(corr)))
+
+
+# Referencia sin estado: todas las features de una ventana (N, 3) calculadas desde cero
+def window_features(xyz, rate=RATE_HZ, bands=BANDS_HZ):
+    v = xyz.astype(np.int64)
+    sums = _per_sample(v, None).sum(axis=0, keepdims=True)
+    moments = _moments(sums, len(v), rate)[0]
+    return np.concatenate((moments, band_energy(xyz[None].astype(np.float32), rate, bands)[0]))
+
+
+_CHUNK = 256  # Muestras máximas procesadas de una vez por dispositivo
+
+
+class _DeviceState:
+    def __init__(self, window):
+        self.window = window
+        self.count = 0                                  # Muestras recibidas
+        self.prefix = np.zeros((1, 12), dtype=np.int64)  # Últimas window+1 sumas prefijo
+        self.previous = None                            # Última muestra (para |Δ|)
+        self.ring = SampleRing(window + _CHUNK)         # Muestras crudas para la FFT
+
+
+# Sink (alias, t_recv_ns, packet) que calcula features cada "hop" sobre ventanas de
+# "window" segundos y las entrega a los consumidores: consumer(alias, t_end_us, features, ready)
+# con features float32 en el orden de self.names, t_end_us en tiempo del dispositivo y
+# ready el time.monotonic() en que la ventana quedó completa (para medir la latencia).
+# Las ventanas (de todos los dispositivos) se agrupan en lotes de batch_windows para una
+# sola FFT; ninguna espera más de max_delay_s: un temporizador entrega el lote aunque no
+# lleguen más paquetes (en ese caso los consumidores se llaman desde su hilo).
+# batch_windows=1 calcula cada ventana al momento.
+class FeatureEngine:
+    def __init__(self, window_s=WINDOW_SECONDS, hop_s=HOP_SECONDS, rate=RATE_HZ, bands=BANDS_HZ,
+                 batch_windows=BATCH_WINDOWS, max_delay_s=BATCH_MAX_DELAY):
+        self.window = int(window_s * rate)
+        self.hop = int(hop_s * rate)
+        self.rate = rate
+        self.bands = bands
+        self.batch_windows = batch_windows
+        self.max_delay = max_delay_s
+        self.names = feature_names(bands)
+        self.devices = {}
+        self.consumers = []
+        self.windows = 0
+        self._pending = []  # (alias, t_end, sumas, ventana, lista desde)
+        self._lock = threading.Lock()  # Entre la recepción y el temporizador de max_delay
+        self._timer = None
+
+    def add_consumer(self, consumer):
+        self.consumers.append(consumer)
+
+    def __call__(self, alias, t_recv, packet):
+        self.add_samples(alias, sample_timestamps_us(packet),
+                         np.column_stack((packet["x"], packet["y"], packet["z"])))
+
+    def add_samples(self, alias, t, xyz):
+        with self._lock:
+            state = self.devices.get(alias)
+            if state is None:
+                state = self.devices[alias] = _DeviceState(self.window)
+            for start in range(0, len(t), _CHUNK):
+                self._add_chunk(alias, state, t[start:start + _CHUNK], xyz[start:start + _CHUNK])
+            if not self._pending:
+                return
+            if len(self._pending) >= self.batch_windows:
+                self._flush()
+            elif self._timer is None:
+                self._schedule(self.max_delay)
+
+    def _schedule(self, delay):
+        self._timer = threading.Timer(delay, self._timer_expired)
+        self._timer.daemon = True
+        self._timer.start()
+
+    # La ventana más antigua ha esperado max_delay: se entrega el lote aunque esté incompleto
+    def _timer_expired(self):
+        with self._lock:
+            if self._timer is not threading.current_thread():
+                return  # Temporizador ya sustituido o cancelado
+            self._timer = None
+            if not self._pending:
+                return
+            remaining = self._pending[0][4] + self.max_delay - time.monotonic()
+            if remaining > 0:
+                self._schedule(remaining)
+            else:
+                self._flush()
+
+    def _add_chunk(self, alias, state, t, xyz):
+        n = len(t)
+        v = xyz.astype(np.int64)
+        prefix = np.vstack((state.prefix, state.prefix[-1] + np.cumsum(_per_sample(v, state.previous), axis=0)))
+        base = state.count + 1 - len(state.prefix)  # prefix[j] = P_(base + j)
+        state.ring.append(t, xyz[:, 0], xyz[:, 1], xyz[:, 2], np.zeros(n, dtype=np.uint32))
+
+        # Ventanas que terminan dentro de este tramo
+        first = max(-(-(state.count + 1) // self.hop) * self.hop, -(-self.window // self.hop) * self.hop)
+        ends = np.arange(first, state.count + n + 1, self.hop)
+        if len(ends):
+            ready = time.monotonic()
+            sums = prefix[ends - base] - prefix[ends - self.window - base]
+            # El jerk de la ventana son sus window-1 diferencias internas
+            sums[:, 9:] = prefix[ends - base, 9:] - prefix[ends - self.window + 1 - base, 9:]
+            recent = state.ring.last(self.window + state.count + n - int(ends[0]))
+            stacked = np.column_stack((recent["x"], recent["y"], recent["z"]))
+            for end, window_sums in zip(ends, sums):
+                offset = int(end) - int(ends[0])
+                self._pending.append((alias, int(t[end - state.count - 1]), window_sums,
+                                      stacked[offset:offset + self.window], ready))
+
+        state.count += n
+        state.previous = v[-1:]
+        state.prefix = prefix[-(self.window + 1):]
+
+    # Calcula momentos y parte espectral de todas las ventanas pendientes a la vez y las entrega
+    def flush(self):
+        with self._lock:
+            self._flush()
+
+    def _flush(self):
+        if self._timer is not None:
+            self._timer.cancel()
+            self._timer = None
+        if not self._pending:
+            return
+        moments = _moments(np.stack([item[2] for item in self._pending]), self.window, self.rate)
+        energy = band_energy(np.stack([item[3] for item in self._pending]).astype(np.float32),
+                             self.rate, self.bands)
+        features = np.hstack((moments, energy)).astype(np.float32)
+        for (alias, t_end, _, _, ready), row in zip(self._pending, features):
+            for consumer in self.consumers:
+                consumer(alias, t_end, row, ready)
+        self.windows += len(self._pending)
+        self._pending = []
+
+    def close(self):
+        self.flush()
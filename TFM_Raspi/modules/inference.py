@@ -0,0 +1,276 @@
+import glob
+import os
+import queue
+import threading
+import time
+
+import numpy as np
+
+from modules.features import FeatureEngine, feature_names
+from modules.pipeline import LatencyStats
+
+# Inferencia en tiempo real con los modelos de data/models.
+# Las ventanas de features de todos los dispositivos se juntan en un lote y se evalúan
+# con una sola llamada al modelo. El lote se lanza cuando hay una ventana de cada
+# dispositivo activo o cuando esperar más rompería el presupuesto de latencia.
+
+MODELS_DIR = os.path.join(os.path.dirname(os.path.dirname(os.path.abspath(__file__))), "data", "models")
+
+LATENCY_BUDGET_MS = 100.0  # Desde que la ventana está lista hasta que sale la decisión
+MAX_BATCH = 64
+FEATURE_DELAY_SHARE = 0.5  # Parte del presupuesto que una ventana puede esperar a su lote de FFT
+QUEUE_MAXSIZE = 4 * MAX_BATCH  # Ventanas en espera; si se llena se descarta la más antigua
+
+
+# ------------------------------ BACK ENDS ------------------------------
+# Todos exponen predict(batch float32 (B, F)) -> puntuaciones float32 (B, clases)
+
+# TFLite (tflite_runtime o tensorflow). Con modelos int8 se cuantiza la entrada y se
+# descuantiza la salida con los parámetros del propio modelo.
+class TFLiteModel:
+    def __init__(self, path, threads=2):
+        try:
+            from tflite_runtime.interpreter import Interpreter
+        except ImportError:
+            from tensorflow.lite import Interpreter
+        self.interpreter = Interpreter(model_path=path, num_threads=threads)
+        self.input = self.interpreter.get_input_details()[0]
+        self.output = self.interpreter.get_output_details()[0]
+        self.quantized = self.input["dtype"] in (np.int8, np.uint8)
+        self._batch = None
+
+    def predict(self, batch):
+        if self._batch != len(batch):
+            # El lote cambia de tamaño: se redimensiona la entrada (solo entonces)
+            self.interpreter.resize_tensor_input(self.input["index"], [len(batch), batch.shape[1]])
+            self.interpreter.allocate_tensors()
+            self.input = self.interpreter.get_input_details()[0]
+            self.output = self.interpreter.get_output_details()[0]
+            self._batch = len(batch)
+        data = batch
+        if self.quantized:
+            scale, zero = self.input["quantization"]
+            info = np.iinfo(self.input["dtype"])
+            data = np.clip(np.round(batch / scale + zero), info.min, info.max).astype(self.input["dtype"])
+        self.interpreter.set_tensor(self.input["index"], data)
+        self.interpreter.invoke()
+        out = self.interpreter.get_tensor(self.output["index"])
+        if self.output["dtype"] in (np.int8, np.uint8):
+            scale, zero = self.output["quantization"]
+            out = (out.astype(np.float32) - zero) * scale
+        return out.astype(np.float32)
+
+
+# ONNX Runtime en CPU (admite los modelos cuantizados con QDQ/int8 de onnxruntime)
+class ONNXModel:
+    def __init__(self, path, threads=2):
+        import onnxruntime as ort
+        options = ort.SessionOptions()
+        options.intra_op_num_threads = threads
+        self.session = ort.InferenceSession(path, options, providers=["CPUExecutionProvider"])
+        self.input_name = self.session.get_inputs()[0].name
+
+    def predict(self, batch):
+        return np.asarray(self.session.run(None, {self.input_name: batch})[0], dtype=np.float32)
+
+
+# Sin modelo entrenado: reposo / movimiento según la varianza total (para probar el
+# sistema de punta a punta y medir la sobrecarga del lote)
+class HeuristicModel:
+    LABELS = ["reposo", "movimiento"]
+    VAR_THRESHOLD = 200.0 ** 2  # cuentas² (~0,025 g a ±2g)
+
+    def __init__(self, names=None):
+        names = names or feature_names()
+        self.var_columns = [names.index(f"{axis}_var") for axis in ("x", "y", "z")]
+
+    def predict(self, batch):
+        moving = batch[:, self.var_columns].sum(axis=1) > self.VAR_THRESHOLD
+        return np.column_stack((~moving, moving)).astype(np.float32)
+
+
+# Busca el modelo en data/models: primero .tflite (mejor los int8), después .onnx.
+# Las etiquetas van en <modelo>.labels.txt (una por línea).
+# Si ninguno se puede cargar (sin runtime, fichero corrupto o incompatible) se usa el heurístico.
+def load_model(path=None, models_dir=MODELS_DIR, threads=2):
+    if path is None:
+        candidates = sorted(glob.glob(os.path.join(models_dir, "*.tflite")),
+                            key=lambda p: ("int8" not in p, p))
+        candidates += sorted(glob.glob(os.path.join(models_dir, "*.onnx")), key=lambda p: ("int8" not in p, p))
+    else:
+        candidates = [path]
+    for candidate in candidates:
+        try:
+            return _load(candidate, threads)
+        except ImportError as e:
+            print(f"[Inferencia] Sin runtime para {os.path.basename(candidate)}: {e}")
+        except Exception as e:
+            print(f"[Inferencia] No se pudo cargar {os.path.basename(candidate)}: {e}")
+    print("[Inferencia] No hay modelo utilizable: se usa el heurístico reposo/movimiento")
+    return HeuristicModel(), HeuristicModel.LABELS
+
+
+def _load(path, threads):
+    model = TFLiteModel(path, threads) if path.endswith(".tflite") else ONNXModel(path, threads)
+    labels_path = os.path.splitext(path)[0] + ".labels.txt"
+    labels = None
+    if os.path.exists(labels_path):
+        with open(labels_path, encoding="utf-8") as f:
+            labels = [line.strip() for line in f if line.strip()]
+    print(f"[Inferencia] Modelo cargado: {os.path.basename(path)}")
+    return model, labels
+
+
+# ------------------------------ MOTOR ------------------------------
+
+# Consumidor de FeatureEngine: submit(alias, t_end, features, ready) solo encola y nunca bloquea.
+# Un hilo forma los lotes y evalúa el modelo; on_decision(alias, t_end, etiqueta, puntuación).
+# La cola está acotada: si el modelo no da abasto se descarta la ventana más antigua
+# (una decisión atrasada ya no sirve) y se cuenta en dropped.
+class InferenceEngine:
+    def __init__(self, model=None, labels=None, latency_budget_ms=LATENCY_BUDGET_MS, max_batch=MAX_BATCH,
+                 on_decision=None, maxsize=QUEUE_MAXSIZE):
+        if model is None:
+            model, labels = load_model()
+        self.model = model
+        self.labels = labels
+        self.budget = latency_budget_ms / 1000
+        self.max_batch = max_batch
+        self.on_decision = on_decision or self._print_decision
+        self.latency = LatencyStats()    # Ventana completa -> decisión (extremo a extremo)
+        self.inference = LatencyStats()  # Solo la llamada al modelo, por lote
+        self.decisions = 0
+        self.batches = 0
+        self.over_budget = 0
+        self.dropped = 0
+        self._model_time = 0.0           # Media móvil del tiempo de una llamada
+        self._active = {}                # alias -> última vez que envió una ventana
+        self._last_label = {}
+        self._queue = queue.Queue(maxsize)
+        self._started = time.monotonic()
+        self._thread = threading.Thread(target=self._run, name="tfm-inference", daemon=True)
+        self._thread.start()
+
+    # ready: time.monotonic() en que la ventana quedó completa (FeatureEngine); la latencia
+    # y el plazo del lote se cuentan desde ahí, incluida la espera al lote de FFT
+    def submit(self, alias, t_end, features, ready=None):
+        item = (time.monotonic() if ready is None else ready, alias, t_end, features)
+        while True:
+            try:
+                self._queue.put_nowait(item)
+                return
+            except queue.Full:
+                pass
+            try:
+                self._queue.get_nowait()
+                self.dropped += 1
+            except queue.Empty:
+                pass  # El hilo de inferencia la vació entre medias
+
+    __call__ = submit
+
+    # Dispositivos que han enviado ventanas en los últimos 2 s
+    def _expected(self, now):
+        return sum(1 for t in self._active.values() if now - t < 2.0)
+
+    def _run(self):
+        running = True
+        while running:
+            item = self._queue.get()
+            if item is None:
+                return
+            self._active[item[1]] = item[0]
+            batch = [item]
+            # Se espera al resto de dispositivos mientras quede presupuesto para evaluar;
+            # después entra también lo que ya esté en la cola
+            deadline = item[0] + max(self.budget - 2 * self._model_time, 0)
+            while len(batch) < self.max_batch:
+                remaining = deadline - time.monotonic()
+                waiting = remaining > 0 and len({b[1] for b in batch}) < self._expected(time.monotonic())
+                try:
+                    item = self._queue.get(timeout=remaining) if waiting else self._queue.get_nowait()
+                except queue.Empty:
+                    if waiting:
+                        continue  # Plazo agotado: se recoge lo que haya sin esperar
+                    break
+                if item is None:
+                    running = False
+                    break
+                self._active[item[1]] = item[0]
+                batch.append(item)
+            self._evaluate(batch)
+
+    def _evaluate(self, batch):
+        features = np.stack([b[3] for b in batch]).astype(np.float32)
+        start = time.monotonic()
+        try:
+            scores = self.model.predict(features)
+        except Exception as e:
+            print(f"[Inferencia] Error evaluando el lote: {e}")
+            return
+        end = time.monotonic()
+        elapsed = end - start
+        self._model_time = elapsed if self.batches == 0 else 0.9 * self._model_time + 0.1 * elapsed
+        self.inference.add(elapsed)
+        self.batches += 1
+
+        best = scores.argmax(axis=1)
+        for (ready, alias, t_end, _), k, row in zip(batch, best, scores):
+            latency = end - ready
+            self.latency.add(latency)
+            if latency > self.budget:
+                self.over_budget += 1
+            label = self.labels[k] if self.labels and k < len(self.labels) else str(k)
+            self.on_decision(alias, t_end, label, float(row[k]))
+        self.decisions += len(batch)
+
+    # Por defecto solo se avisa cuando cambia la actividad de un dispositivo
+    def _print_decision(self, alias, t_end, label, score):
+        if self._last_label.get(alias) != label:
+            self._last_label[alias] = label
+            print(f"[{alias}] Actividad: {label} ({score:.2f})")
+
+    def stats(self):
+        elapsed = time.monotonic() - self._started
+        return {
+            "decisions": self.decisions,
+            "decisions_per_s": self.decisions / elapsed if elapsed else 0.0,
+            "mean_batch": self.decisions / self.batches if self.batches else 0.0,
+            "inference": self.inference.as_dict(),
+            "latency": self.latency.as_dict(),
+            "over_budget": self.over_budget,
+            "dropped": self.dropped,
+        }
+
+    def print_stats(self):
+        s = self.stats()
+        print(f"[Inferencia] {s['decisions']} decisiones ({s['decisions_per_s']:.1f}/s), "
+              f"lote medio {s['mean_batch']:.1f}, fuera de presupuesto {s['over_budget']}, "
+              f"descartadas {s['dropped']}")
+        for name, key in (("modelo por lote", "inference"), ("extremo a extremo", "latency")):
+            print(f"  {name}: media {s[key]['mean_ms']:.2f} ms, máx {s[key]['max_ms']:.2f} ms "
+                  f"(presupuesto {self.budget * 1000:.0f} ms)")
+
+    def close(self):
+        self._queue.put(None)
+        self._thread.join()
+        self.print_stats()
+
+
+# Sink (alias, t_recv_ns, packet) completo: features por ventana + inferencia por lotes.
+# Sirve como factory del consumidor "inference" de modules/multiproc.py.
+# El lote de FFT del FeatureEngine se entrega como mucho a FEATURE_DELAY_SHARE del
+# presupuesto; el resto queda para formar el lote del modelo y evaluarlo.
+class InferenceSink:
+    def __init__(self, model_path=None, latency_budget_ms=LATENCY_BUDGET_MS):
+        self.features = FeatureEngine(max_delay_s=latency_budget_ms / 1000 * FEATURE_DELAY_SHARE)
+        model, labels = load_model(model_path)
+        self.engine = InferenceEngine(model, labels, latency_budget_ms)
+        self.features.add_consumer(self.engine.submit)
+
+    def __call__(self, alias, t_recv, packet):
+        self.features(alias, t_recv, packet)
+
+    def close(self):
+        self.features.close()
+        self.engine.close()
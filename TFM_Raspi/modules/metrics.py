@@ -0,0 +1,236 @@
+import asyncio
+import os
+import time
+
+# Métricas de operación en formato de exposición de Prometheus (texto 0.0.4), sin
+# dependencias: un endpoint HTTP local (GET /metrics) y/o un fichero para el textfile
+# collector de node_exporter.
+# En el camino caliente solo se incrementan enteros de DeviceMetrics desde el bucle
+# asyncio (un único hilo: sin locks). Las tasas por segundo, el estado de las colas y los
+# percentiles (PacketTracer) se calculan por intervalo o al servir la petición.
+
+METRICS_INTERVAL = 10.0   # s entre cálculos de tasas (y escrituras del fichero)
+QUANTILES = (0.5, 0.95, 0.99)
+CONTENT_TYPE = "text/plain; version=0.0.4; charset=utf-8"
+
+
+# Contadores de un dispositivo (solo se incrementan desde el bucle asyncio)
+class DeviceMetrics:
+    __slots__ = ("packets", "samples", "decode_errors", "reconnects", "packets_per_s", "samples_per_s", "_last_packets", "_last_samples")
+
+    def __init__(self):
+        self.packets = 0
+        self.samples = 0
+        self.decode_errors = 0
+        self.reconnects = 0
+        self.packets_per_s = 0.0
+        self.samples_per_s = 0.0
+        self._last_packets = 0
+        self._last_samples = 0
+
+
+def _escape(value):
+    return str(value).replace("\\", "\\\\").replace("\"", "\\\"").replace("\n", "\\n")
+
+
+def _labels(labels):
+    if not labels:
+        return ""
+    return "{" + ",".join(f"{key}=\"{_escape(value)}\"" for key, value in labels.items()) + "}"
+
+
+def _number(value):
+    return str(value) if isinstance(value, int) else f"{float(value):.6g}"
+
+
+# Acumula las muestras agrupadas por métrica: el formato exige que cada familia
+# (HELP, TYPE y todas sus series) vaya seguida
+class _Exposition:
+    def __init__(self):
+        self.families = {}  # nombre -> [líneas], en orden de primera aparición
+
+    def _family(self, name, kind, help_text):
+        lines = self.families.get(name)
+        if lines is None:
+            lines = self.families[name] = [f"# HELP {name} {help_text}", f"# TYPE {name} {kind}"]
+        return lines
+
+    def add(self, name, kind, help_text, value, labels=None):
+        self._family(name, kind, help_text).append(f"{name}{_labels(labels)} {_number(value)}")
+
+    # Histograma de tracing.py (ms) como summary de Prometheus (segundos)
+    def summary(self, name, help_text, histogram, labels):
+        if histogram.count == 0:
+            return
+        lines = self._family(name, "summary", help_text)
+        for q in QUANTILES:
+            lines.append(f"{name}{_labels({**labels, 'quantile': q})} {_number(histogram.percentile(q * 100) / 1000)}")
+        lines.append(f"{name}_sum{_labels(labels)} {_number(histogram.total / 1000)}")
+        lines.append(f"{name}_count{_labels(labels)} {histogram.count}")
+
+    def text(self):
+        return "\n".join(line for lines in self.families.values() for line in lines) + "\n"
+
+
+class MetricsExporter:
+    # ble: BLEManager del que se leen dispositivos, colas, sinks y trazas.
+    # port: endpoint HTTP (None = sin servidor); textfile: ruta del fichero .prom (None = no)
+    def __init__(self, ble, host="127.0.0.1", port=None, textfile=None, interval=METRICS_INTERVAL):
+        self.ble = ble
+        self.host = host
+        self.port = port
+        self.textfile = textfile
+        self.interval = interval
+        self.devices = {}  # alias -> DeviceMetrics
+        self._server = None
+        self._task = None
+        self._last_tick = time.monotonic()
+
+    def device(self, alias):
+        metrics = self.devices.get(alias)
+        if metrics is None:
+            metrics = self.devices[alias] = DeviceMetrics()
+        return metrics
+
+    # ---- Camino caliente (llamadas desde BLEManager) ----
+
+    def packet(self, alias, packet):
+        metrics = self.device(alias)
+        metrics.packets += 1
+        metrics.samples += len(packet["x"])
+
+    def decode_error(self, alias):
+        self.device(alias).decode_errors += 1
+
+    def reconnected(self, alias):
+        self.device(alias).reconnects += 1
+
+    # ---- Agregación por intervalo ----
+
+    def _tick(self):
+        now = time.monotonic()
+        elapsed = max(now - self._last_tick, 1e-9)
+        self._last_tick = now
+        for metrics in self.devices.values():
+            metrics.packets_per_s = (metrics.packets - metrics._last_packets) / elapsed
+            metrics.samples_per_s = (metrics.samples - metrics._last_samples) / elapsed
+            metrics._last_packets = metrics.packets
+            metrics._last_samples = metrics.samples
+
+    async def _run(self):
+        while True:
+            await asyncio.sleep(self.interval)
+            self._tick()
+            if self.textfile is not None:
+                try:
+                    await asyncio.to_thread(self._write_textfile, self.render())
+                except OSError as e:
+                    print(f"[Métricas] No se pudo escribir {self.textfile}: {e}")
+
+    # Escritura atómica: el collector nunca lee un fichero a medias
+    def _write_textfile(self, text):
+        tmp = self.textfile + ".tmp"
+        with open(tmp, "w", encoding="utf-8") as f:
+            f.write(text)
+        os.replace(tmp, self.textfile)
+
+    # ---- Exposición ----
+
+    def render(self):
+        out = _Exposition()
+
+        states = {info['alias']: (mac, info.get('state', "conectado"))
+                  for mac, info in self.ble.connected_devices.items()}
+        for alias, (mac, state) in states.items():
+            out.add("tfm_device_connected", "gauge", "1 si el dispositivo está conectado",
+                    1 if state == "conectado" else 0, {"device": alias, "mac": mac})
+
+        for alias, m in sorted(self.devices.items()):
+            labels = {"device": alias}
+            out.add("tfm_packets_received_total", "counter", "Paquetes decodificados", m.packets, labels)
+            out.add("tfm_samples_received_total", "counter", "Muestras decodificadas", m.samples, labels)
+            out.add("tfm_packets_per_second", "gauge", "Paquetes/s en el último intervalo", m.packets_per_s, labels)
+            out.add("tfm_samples_per_second", "gauge", "Muestras/s en el último intervalo", m.samples_per_s, labels)
+            out.add("tfm_decode_errors_total", "counter", "Paquetes que no se pudieron decodificar",
+                    m.decode_errors, labels)
+            out.add("tfm_reconnects_total", "counter", "Reconexiones automáticas", m.reconnects, labels)
+
+        # Pérdidas según sequence_id (modules/sequencer.py)
+        for alias, s in sorted(self.ble.sequencer.stats().items()):
+            labels = {"device": alias}
+            out.add("tfm_sequence_gaps_total", "counter", "Huecos en sequence_id", s["gaps"], labels)
+            out.add("tfm_packets_lost_total", "counter", "Paquetes que faltan en los huecos de secuencia",
+                    s["lost_packets"], labels)
+            out.add("tfm_samples_lost_total", "counter", "Muestras que faltan en los huecos de secuencia",
+                    s["lost_samples"], labels)
+            out.add("tfm_packets_duplicated_total", "counter", "Paquetes repetidos o llegados tras darlos por perdidos",
+                    s["duplicates"], labels)
+            out.add("tfm_packets_reordered_total", "counter", "Paquetes desordenados recolocados en la ventana",
+                    s["reordered"], labels)
+
+        for s in self.ble.pipeline.stats():
+            labels = {"stage": s["stage"]}
+            out.add("tfm_queue_depth", "gauge", "Elementos en la cola de la etapa", s["depth"], labels)
+            out.add("tfm_queue_capacity", "gauge", "Tamaño máximo de la cola de la etapa", s["maxsize"], labels)
+            out.add("tfm_stage_processed_total", "counter", "Elementos procesados por la etapa", s["processed"], labels)
+            out.add("tfm_stage_dropped_total", "counter", "Elementos descartados con la cola llena", s["dropped"], labels)
+            out.add("tfm_stage_errors_total", "counter", "Excepciones en la etapa", s["errors"], labels)
+
+        for sink in self.ble.sinks:
+            if hasattr(sink, "dropped"):
+                out.add("tfm_sink_dropped_total", "counter", "Paquetes descartados por un sink lento",
+                        sink.dropped, {"sink": type(getattr(sink, "sink", sink)).__name__})
+
+        tracer = self.ble.tracer
+        if tracer is not None:
+            for key, histogram in tracer.segments.items():
+                out.summary("tfm_latency_seconds", "Latencia por tramo, todos los dispositivos (modules/tracing.py)",
+                            histogram, {"segment": key})
+            for alias, segments in sorted(tracer.devices.items()):
+                for key, histogram in segments.items():
+                    out.summary("tfm_device_latency_seconds", "Latencia por tramo y dispositivo",
+                                histogram, {"segment": key, "device": alias})
+            out.summary("tfm_loop_lag_seconds", "Retraso del bucle asyncio", tracer.loop_lag.histogram, {})
+
+        return out.text()
+
+    # ---- Servidor HTTP mínimo (solo GET /metrics) ----
+
+    async def _handle(self, reader, writer):
+        try:
+            request = await asyncio.wait_for(reader.readline(), timeout=5)
+            while (await asyncio.wait_for(reader.readline(), timeout=5)) not in (b"\r\n", b"\n", b""):
+                pass  # Cabeceras: no se usan
+            parts = request.decode("latin-1").split()
+            if len(parts) >= 2 and parts[0] == "GET" and parts[1].split("?")[0] == "/metrics":
+                status, body, content_type = "200 OK", self.render().encode("utf-8"), CONTENT_TYPE
+            else:
+                status, body, content_type = "404 Not Found", b"Ruta no encontrada: use /metrics\n", "text/plain"
+            writer.write(f"HTTP/1.1 {status}\r\nContent-Type: {content_type}\r\n"
+                         f"Content-Length: {len(body)}\r\nConnection: close\r\n\r\n".encode("latin-1") + body)
+            await writer.drain()
+        except (asyncio.TimeoutError, ConnectionError):
+            pass
+        finally:
+            writer.close()
+
+    async def start(self):
+        self._last_tick = time.monotonic()
+        self._task = asyncio.get_running_loop().create_task(self._run())
+        if self.port is not None:
+            try:
+                self._server = await asyncio.start_server(self._handle, self.host, self.port)
+                print(f"[Métricas] http://{self.host}:{self.port}/metrics")
+            except OSError as e:
+                print(f"[Métricas] No se pudo abrir el puerto {self.port}: {e}")
+        if self.textfile is not None:
+            print(f"[Métricas] Fichero {self.textfile} (cada {self.interval:.0f} s)")
+
+    async def stop(self):
+        if self._task is not None:
+            self._task.cancel()
+            self._task = None
+        if self._server is not None:
+            self._server.close()
+            await self._server.wait_closed()
+            self._server = None
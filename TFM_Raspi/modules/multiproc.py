@@ -0,0 +1,217 @@
+import multiprocessing as mp
+import os
+import queue
+import threading
+import time
+
+from modules.data_handler import decode_packets
+
+# Reparto por defecto de procesos en los 4 núcleos de la Raspberry Pi
+DEFAULT_CPU_MAP = {
+    "io": 0,         # Proceso principal: BLEManager y conexiones BlueZ
+    "decode": 1,     # Decodificación (y futuras features)
+    "store": 2,      # Almacenamiento
+    "inference": 3,  # Inferencia
+}
+
+QUEUE_SIZE = 1024    # Elementos máximos en cada cola entre procesos
+DECODE_BATCH = 64    # Paquetes que el decodificador agrupa como máximo por llamada
+_STOP = None         # Centinela de fin de cola
+
+
+# Fija el proceso actual a un núcleo (solo Linux; en otros sistemas se ignora)
+def pin_to_core(core):
+    if core is None or not hasattr(os, "sched_setaffinity"):
+        return
+    try:
+        os.sched_setaffinity(0, {core % os.cpu_count()})
+    except OSError as e:
+        print(f"No se pudo fijar el proceso {os.getpid()} al núcleo {core}: {e}")
+
+
+# Handler por defecto de un consumidor: solo cuenta paquetes y muestras
+class _CountingHandler:
+    def __init__(self):
+        self.packets = 0
+        self.samples = 0
+
+    def __call__(self, alias, t_recv, packet):
+        self.packets += 1
+        self.samples += len(packet["x"])
+
+
+# ----------------------- PROCESOS TRABAJADORES -----------------------
+# Funciones de módulo para poder lanzarlas con el método "spawn".
+
+# Decodificador: recibe (mac, alias, t_recv_ns, bytes), decodifica por lotes con NumPy,
+# reparte los paquetes a los consumidores y devuelve los créditos al proceso de E/S
+def decode_worker(raw_q, ack_q, out_qs, core):
+    pin_to_core(core)
+    packets = errors = 0
+    running = True
+
+    while running:
+        batch = [raw_q.get()]
+        while len(batch) < DECODE_BATCH:
+            try:
+                batch.append(raw_q.get_nowait())
+            except queue.Empty:
+                break
+        # _STOP puede no ser el último: set_raw_publisher(None) llega desde otro hilo y aún
+        # puede colarse algún paquete detrás. Lo posterior a _STOP se descarta.
+        for index, item in enumerate(batch):
+            if item is _STOP:
+                del batch[index:]
+                running = False
+                break
+        if not batch:
+            continue
+
+        result = decode_packets([item[3] for item in batch])
+        errors += result["errors"]
+        valid = result["valid"]
+        offsets = result["offsets"]
+
+        k = 0
+        for item, ok in zip(batch, valid):
+            if not ok:
+                continue
+            mac, alias, t_recv, _ = item
+            start, end = offsets[k], offsets[k + 1]
+            packet = {
+                "sample_rate": int(result["sample_rate"][k]),
+                "sequence_id": int(result["sequence_id"][k]),
+                "timestamp_start": int(result["timestamp_start"][k]),
+                "x": result["x"][start:end],
+                "y": result["y"][start:end],
+                "z": result["z"][start:end],
+            }
+            for out_q in out_qs:
+                try:
+                    out_q.put_nowait((alias, t_recv, packet))
+                except queue.Full:
+                    pass # Consumidor saturado: pierde el paquete, el resto sigue
+            k += 1
+        packets += k
+
+        # Créditos: un aviso por dispositivo y lote
+        acks = {}
+        for item in batch:
+            acks[item[0]] = acks.get(item[0], 0) + 1
+        for mac, n in acks.items():
+            ack_q.put((mac, n))
+
+    for out_q in out_qs:
+        out_q.put(_STOP)
+    print(f"[decode:{os.getpid()}] Fin. Paquetes decodificados {packets}, errores {errors}")
+
+
+# Consumidor genérico (almacenamiento, inferencia...). "factory" crea dentro del proceso
+# hijo el handler(alias, t_recv_ns, packet); debe ser una función de módulo (picklable).
+def consumer_worker(name, in_q, core, factory):
+    pin_to_core(core)
+    handler = factory() if factory is not None else _CountingHandler()
+    processed = 0
+    busy = 0.0
+
+    while True:
+        item = in_q.get()
+        if item is _STOP:
+            break
+        start = time.perf_counter()
+        try:
+            handler(*item)
+        except Exception as e:
+            print(f"[{name}:{os.getpid()}] Error procesando paquete: {e}")
+        busy += time.perf_counter() - start
+        processed += 1
+
+    close = getattr(handler, "close", None)
+    if close is not None:
+        close()
+    mean_ms = (busy / processed * 1000) if processed else 0.0
+    print(f"[{name}:{os.getpid()}] Fin. Paquetes {processed}, proceso medio {mean_ms:.3f} ms")
+
+
+# ------------------------- PROCESO DE E/S -------------------------
+
+# Orquesta la arquitectura multiproceso. El proceso actual (el que tiene el BLEManager)
+# queda como proceso de E/S: solo recibe notificaciones y publica los bytes crudos.
+# Decodificación, almacenamiento e inferencia corren en procesos aparte, cada uno
+# fijado a un núcleo, y así escapan del GIL del proceso de E/S.
+class ProcessHost:
+    def __init__(self, ble_manager, consumers=None, cpu_map=None, queue_size=QUEUE_SIZE):
+        self.ble = ble_manager
+        # {nombre: factory} de los consumidores; None = solo contar
+        self.consumers = consumers if consumers is not None else {"store": None, "inference": None}
+        self.cpu_map = {**DEFAULT_CPU_MAP, **(cpu_map or {})}
+        self.queue_size = queue_size
+        self.published = 0
+        self.dropped = 0
+        self._ctx = mp.get_context("spawn")
+        self._processes = []
+        self._ack_thread = None
+        self._loop = None
+
+    def start(self, loop):
+        self._loop = loop
+        ctx = self._ctx
+        self.raw_q = ctx.Queue(self.queue_size)
+        self.ack_q = ctx.Queue()
+        self.consumer_qs = {name: ctx.Queue(self.queue_size) for name in self.consumers}
+
+        for name, factory in self.consumers.items():
+            self._processes.append(ctx.Process(
+                target=consumer_worker, name=f"tfm-{name}", daemon=True,
+                args=(name, self.consumer_qs[name], self.cpu_map.get(name), factory)))
+        self._processes.append(ctx.Process(
+            target=decode_worker, name="tfm-decode", daemon=True,
+            args=(self.raw_q, self.ack_q, list(self.consumer_qs.values()), self.cpu_map.get("decode"))))
+        for process in self._processes:
+            process.start()
+
+        pin_to_core(self.cpu_map.get("io"))
+
+        # Hilo que recoge los avisos de créditos del decodificador
+        self._ack_thread = threading.Thread(target=self._ack_reader, name="tfm-acks", daemon=True)
+        self._ack_thread.start()
+
+        self.ble.set_raw_publisher(self.publish)
+        print(f"Arquitectura multiproceso activa: {', '.join(p.name for p in self._processes)}")
+
+    # Llamado desde el callback de Bleak: solo mete los bytes en la cola entre procesos
+    def publish(self, mac, alias, t_recv, data):
+        try:
+            self.raw_q.put_nowait((mac, alias, t_recv, bytes(data)))
+            self.published += 1
+        except queue.Full:
+            self.dropped += 1
+            self.ble._packet_consumed(mac) # El crédito se devuelve aunque se descarte
+
+    def _ack_reader(self):
+        while True:
+            ack = self.ack_q.get()
+            if ack is _STOP:
+                break
+            mac, n = ack
+            for _ in range(n):
+                self._loop.call_soon_threadsafe(self.ble._packet_consumed, mac)
+
+    def stats(self):
+        return {
+            "published": self.published,
+            "dropped": self.dropped,
+            "raw_depth": self.raw_q.qsize(),
+            **{f"{name}_depth": q.qsize() for name, q in self.consumer_qs.items()},
+        }
+
+    def stop(self, timeout=5):
+        self.ble.set_raw_publisher(None)
+        self.raw_q.put(_STOP)
+        for process in self._processes:
+            process.join(timeout)
+            if process.is_alive():
+                process.terminate()
+        self.ack_q.put(_STOP)
+        self._ack_thread.join(timeout)
+        print(f"Procesos detenidos. Publicados {self.published}, descartados {self.dropped}")
@@ -0,0 +1,66 @@
+# GENERADO AUTOMATICAMENTE por protocol/gen_packet.py a partir de protocol/accel_packet.json. NO EDITAR.
+import numpy as np
+
+SAMPLES_PER_PACKET = 35  # Numero maximo de muestras por paquete
+FORMAT_VERSION = 2  # Version del formato de paquete (0 = antiguo, sin cabecera; 1 = sin notify_offset_ms)
+ENC_RAW_I16 = 0  # Codificacion: int16 little endian, canales intercalados
+CH_X = 1  # Mascara de canales presentes
+CH_Y = 2
+CH_Z = 4
+CH_XYZ = 7
+RANGE_2G = 0  # Fondo de escala: +-2g, 4g, 8g, 16g
+RANGE_4G = 1
+RANGE_8G = 2
+RANGE_16G = 3
+
+# Campos de bits: {campo: {subcampo: (desplazamiento, máscara)}}
+BITFIELDS = {
+    "format": {"encoding": (0, 0x0F), "version": (4, 0x0F)},
+    "channels": {"mask": (0, 0x0F), "range": (4, 0x0F)},
+}
+
+# Estructura de una muestra (X, Y, Z)
+SAMPLE_DTYPE = np.dtype([
+    ("x", '<i2'),
+    ("y", '<i2'),
+    ("z", '<i2'),
+])
+assert SAMPLE_DTYPE.itemsize == 6
+
+# Cabecera autodescriptiva del paquete (la Raspi decodifica sin configuracion)
+HEADER_DTYPE = np.dtype([
+    ("format", '<u1'),
+    ("channels", '<u1'),
+    ("sample_rate_hz", '<u2'),
+    ("sample_count", '<u1'),
+    ("sequence_id", '<u4'),
+    ("timestamp_start", '<u4'),
+    ("notify_offset_ms", '<u2'),
+])
+assert HEADER_DTYPE.itemsize == 15
+
+# Estructura del paquete a enviar por Bluetooth (solo se envian las muestras validas)
+PACKET_DTYPE = np.dtype([
+    ("header", HEADER_DTYPE),
+    ("samples", SAMPLE_DTYPE, (SAMPLES_PER_PACKET,)),
+])
+assert PACKET_DTYPE.itemsize == 225
+
+# Cabecera de la version 1 (sin notify_offset_ms). Solo para decodificar
+HEADER_V1_DTYPE = np.dtype([
+    ("format", '<u1'),
+    ("channels", '<u1'),
+    ("sample_rate_hz", '<u2'),
+    ("sample_count", '<u1'),
+    ("sequence_id", '<u4'),
+    ("timestamp_start", '<u4'),
+])
+assert HEADER_V1_DTYPE.itemsize == 13
+
+# Paquete del firmware antiguo (version 0, sin cabecera de formato). Solo para decodificar
+LEGACY_PACKET_DTYPE = np.dtype([
+    ("sequence_id", '<u4'),
+    ("timestamp_start", '<u4'),
+    ("samples", SAMPLE_DTYPE, (35,)),
+])
+assert LEGACY_PACKET_DTYPE.itemsize == 218
@@ -0,0 +1,179 @@
+import asyncio
+import time
+
+# Políticas de cola llena
+POLICY_BLOCK = "block"              # El productor espera a que haya hueco (contrapresión)
+POLICY_DROP_NEWEST = "drop_newest"  # Se descarta el elemento que llega
+POLICY_DROP_OLDEST = "drop_oldest"  # Se descarta el elemento más antiguo de la cola
+POLICIES = (POLICY_BLOCK, POLICY_DROP_NEWEST, POLICY_DROP_OLDEST)
+
+
+# Estadísticas de tiempos de una etapa (en segundos)
+class LatencyStats:
+    def __init__(self):
+        self.count = 0
+        self.total = 0.0
+        self.max = 0.0
+        self.last = 0.0
+
+    def add(self, value):
+        self.count += 1
+        self.total += value
+        self.last = value
+        if value > self.max:
+            self.max = value
+
+    def as_dict(self):
+        return {
+            "mean_ms": (self.total / self.count * 1000) if self.count else 0.0,
+            "max_ms": self.max * 1000,
+            "last_ms": self.last * 1000,
+        }
+
+
+# Etapa de procesamiento: cola acotada + tarea consumidora.
+# "handler(item)" procesa un elemento y devuelve lo que se pasa a la siguiente etapa
+# (None = no se propaga); con many=True devuelve una lista (cero o más elementos).
+# "on_release(item)" se llama cuando el elemento sale de la cola, tanto si se procesa
+# como si se descarta. "flush()" (opcional) devuelve la lista de elementos que la etapa
+# aún retiene; Pipeline.stop() los pasa a la siguiente tras vaciar la cola.
+#
+# Las etapas son tareas cooperativas del mismo bucle asyncio, no están aisladas: un handler
+# lento retrasa a las demás etapas y a los callbacks de Bleak. Las colas solo desacoplan
+# ritmos y fijan qué se descarta; para aislar el trabajo pesado está modules/multiproc.py.
+class Stage:
+    def __init__(self, name, handler, maxsize=256, policy=POLICY_BLOCK, on_release=None, many=False,
+                 flush=None):
+        if policy not in POLICIES:
+            raise ValueError(f"Política desconocida '{policy}' (válidas: {', '.join(POLICIES)})")
+        self.name = name
+        self.handler = handler
+        self.policy = policy
+        self.on_release = on_release
+        self.many = many
+        self.flush = flush
+        self.next_stage = None
+        self.queue = asyncio.Queue(maxsize=maxsize)
+        self.processed = 0
+        self.dropped = 0
+        self.errors = 0
+        self.wait = LatencyStats()     # Tiempo en cola
+        self.service = LatencyStats()  # Tiempo de procesamiento
+        self._task = None
+
+    # Encola desde código síncrono (callbacks de Bleak). Nunca bloquea, así que solo vale
+    # para etapas con política de descarte: con "block" no habría contrapresión posible.
+    def offer(self, item):
+        if self.policy == POLICY_BLOCK:
+            raise ValueError(f"La etapa '{self.name}' usa la política '{POLICY_BLOCK}': "
+                             f"solo se puede alimentar con put()")
+        return self._offer(item)
+
+    def _offer(self, item):
+        if self.queue.full():
+            if self.policy == POLICY_DROP_OLDEST:
+                self._drop(self.queue.get_nowait()[1])
+                self.queue.task_done()
+            else:
+                self._drop(item)
+                return False
+        self.queue.put_nowait((time.perf_counter(), item))
+        return True
+
+    # Encola desde una corrutina. Con política "block" espera a que haya hueco.
+    async def put(self, item):
+        if self.policy == POLICY_BLOCK:
+            await self.queue.put((time.perf_counter(), item))
+            return True
+        return self._offer(item)
+
+    def _drop(self, item):
+        self.dropped += 1
+        if self.on_release is not None:
+            self.on_release(item)
+
+    async def _run(self):
+        while True:
+            enqueued, item = await self.queue.get()
+            start = time.perf_counter()
+            self.wait.add(start - enqueued)
+            try:
+                result = self.handler(item)
+            except Exception as e:
+                self.errors += 1
+                result = None
+                print(f"[Pipeline:{self.name}] Error procesando elemento: {e}")
+            self.service.add(time.perf_counter() - start)
+            self.processed += 1
+            if self.on_release is not None:
+                self.on_release(item)
+
+            if result is not None and self.next_stage is not None:
+                for output in (result if self.many else (result,)):
+                    await self.next_stage.put(output)
+            # Tras reenviarlo: así join() garantiza que el elemento ya está en la siguiente etapa
+            self.queue.task_done()
+
+    def start(self):
+        if self._task is None:
+            self._task = asyncio.get_running_loop().create_task(self._run())
+
+    async def stop(self):
+        if self._task is not None:
+            self._task.cancel()
+            try:
+                await self._task
+            except asyncio.CancelledError:
+                pass
+            self._task = None
+
+    def stats(self):
+        return {
+            "stage": self.name,
+            "policy": self.policy,
+            "depth": self.queue.qsize(),
+            "maxsize": self.queue.maxsize,
+            "processed": self.processed,
+            "dropped": self.dropped,
+            "errors": self.errors,
+            "wait": self.wait.as_dict(),
+            "service": self.service.as_dict(),
+        }
+
+
+# Cadena de etapas. La primera recibe los elementos con offer() (debe descartar) o put().
+class Pipeline:
+    def __init__(self, stages):
+        self.stages = list(stages)
+        for current, following in zip(self.stages, self.stages[1:]):
+            current.next_stage = following
+
+    def offer(self, item):
+        return self.stages[0].offer(item)
+
+    async def put(self, item):
+        return await self.stages[0].put(item)
+
+    def start(self):
+        for stage in self.stages:
+            stage.start()
+
+    # Espera a que se vacíen las colas (en orden) y detiene las tareas
+    async def stop(self, drain=True):
+        for stage in self.stages:
+            if drain:
+                await stage.queue.join()
+                if stage.flush is not None and stage.next_stage is not None:
+                    for item in stage.flush():
+                        await stage.next_stage.put(item)
+            await stage.stop()
+
+    def stats(self):
+        return [stage.stats() for stage in self.stages]
+
+    def print_stats(self):
+        for s in self.stats():
+            print(f" [{s['stage']:<8}] cola {s['depth']}/{s['maxsize']} ({s['policy']}), "
+                  f"procesados {s['processed']}, descartados {s['dropped']}, errores {s['errors']}, "
+                  f"espera media {s['wait']['mean_ms']:.2f} ms, proceso medio {s['service']['mean_ms']:.3f} ms "
+                  f"(máx {s['service']['max_ms']:.3f} ms)")
@@ -0,0 +1,45 @@
+import json
+import os
+import time
+
+from config.settings import REGISTRY_PATH
+
+# Registro persistente de dispositivos: qué MAC ocupa qué posición (alias).
+# Sobrevive a reinicios de la Raspi; el modo servicio se conecta a todos al arrancar.
+# Fichero JSON: {"devices": [{"mac", "alias", "name", "registered"}, ...]}
+
+
+class DeviceRegistry:
+    def __init__(self, path=REGISTRY_PATH):
+        self.path = path
+        self.devices = {}  # mac -> {"alias", "name", "registered"}
+        if os.path.exists(path):
+            with open(path, encoding="utf-8") as f:
+                for entry in json.load(f).get("devices", []):
+                    self.devices[entry["mac"]] = {k: v for k, v in entry.items() if k != "mac"}
+
+    # Una posición solo puede tenerla un dispositivo: la asignación nueva sustituye a la anterior
+    def add(self, mac, alias, name=None):
+        for other in [m for m, entry in self.devices.items() if entry["alias"] == alias and m != mac]:
+            del self.devices[other]
+        self.devices[mac] = {"alias": alias, "name": name, "registered": time.strftime("%Y-%m-%d %H:%M:%S")}
+        self.save()
+
+    def remove(self, mac):
+        if self.devices.pop(mac, None) is not None:
+            self.save()
+
+    # [(mac, alias), ...] ordenados por alias
+    def known(self):
+        return sorted(((mac, entry["alias"]) for mac, entry in self.devices.items()), key=lambda item: item[1])
+
+    # Escritura atómica: fichero temporal + rename
+    def save(self):
+        os.makedirs(os.path.dirname(self.path), exist_ok=True)
+        tmp = self.path + ".tmp"
+        with open(tmp, "w", encoding="utf-8") as f:
+            json.dump({"devices": [{"mac": mac, **entry} for mac, entry in self.devices.items()]}, f, indent=2,
+                      ensure_ascii=False)
+            f.flush()
+            os.fsync(f.fileno())
+        os.replace(tmp, self.path)
@@ -0,0 +1,152 @@
+import os
+
+import numpy as np
+
+# Resúmenes multirresolución de una sesión, calculados mientras se graba.
+# Cada nivel guarda por intervalo y eje: mínimo, máximo, suma y suma de cuadrados
+# (media y RMS salen de ahí). Con sumas los niveles se combinan sin perder exactitud:
+# el nivel de minuto se construye con los registros cerrados del nivel de segundo.
+
+# Niveles: nombre -> periodo en µs (de más fino a más grueso)
+TIERS = {
+    "1s": 1_000_000,
+    "1min": 60_000_000,
+}
+
+AXES = ("x", "y", "z")
+
+ROLLUP_DTYPE = np.dtype(
+    [("t", "<i8"), ("count", "<i4")]
+    + [(f"{axis}_{field}", dtype) for axis in AXES
+       for field, dtype in (("min", "<i2"), ("max", "<i2"), ("sum", "<f8"), ("sumsq", "<f8"))])
+
+
+def rollup_path(device_dir, tier):
+    return os.path.join(device_dir, f"rollup_{tier}.bin")
+
+
+def read_rollup(device_dir, tier):
+    path = rollup_path(device_dir, tier)
+    if not os.path.exists(path):
+        return None
+    with open(path, "rb") as f:
+        raw = f.read()
+    usable = len(raw) - len(raw) % ROLLUP_DTYPE.itemsize
+    return np.frombuffer(raw[:usable], dtype=ROLLUP_DTYPE)
+
+
+# Una muestra = un registro de count 1 (para reutilizar la misma agregación)
+def samples_to_records(t, x, y, z):
+    records = np.zeros(len(t), dtype=ROLLUP_DTYPE)
+    records["t"] = t
+    records["count"] = 1
+    for axis, values in zip(AXES, (x, y, z)):
+        v = np.asarray(values)
+        records[f"{axis}_min"] = v
+        records[f"{axis}_max"] = v
+        records[f"{axis}_sum"] = v
+        records[f"{axis}_sumsq"] = v.astype(np.float64) ** 2
+    return records
+
+
+# Agrega registros consecutivos que caen en el mismo intervalo de "period" µs
+def group(records, period):
+    if len(records) == 0:
+        return records[:0].copy()
+    key = records["t"] // period * period
+    starts = np.concatenate(([0], np.flatnonzero(np.diff(key)) + 1))
+    out = np.zeros(len(starts), dtype=ROLLUP_DTYPE)
+    out["t"] = key[starts]
+    out["count"] = np.add.reduceat(records["count"], starts)
+    for axis in AXES:
+        out[f"{axis}_min"] = np.minimum.reduceat(records[f"{axis}_min"], starts)
+        out[f"{axis}_max"] = np.maximum.reduceat(records[f"{axis}_max"], starts)
+        out[f"{axis}_sum"] = np.add.reduceat(records[f"{axis}_sum"], starts)
+        out[f"{axis}_sumsq"] = np.add.reduceat(records[f"{axis}_sumsq"], starts)
+    return out
+
+
+# Pasa de sumas a {t, count, x_min, x_max, x_mean, x_rms, ...}
+def summarize(records):
+    count = records["count"].astype(np.float64)
+    result = {"t": records["t"].copy(), "count": records["count"].copy()}
+    with np.errstate(invalid="ignore", divide="ignore"):
+        for axis in AXES:
+            result[f"{axis}_min"] = records[f"{axis}_min"].copy()
+            result[f"{axis}_max"] = records[f"{axis}_max"].copy()
+            result[f"{axis}_mean"] = records[f"{axis}_sum"] / count
+            result[f"{axis}_rms"] = np.sqrt(records[f"{axis}_sumsq"] / count)
+    return result
+
+
+# Un nivel en escritura: el intervalo abierto queda en memoria y los cerrados se
+# añaden al fichero. Si el proceso muere solo se pierde el intervalo abierto.
+class _TierWriter:
+    def __init__(self, device_dir, tier, period):
+        self.period = period
+        self.open_record = None
+        path = rollup_path(device_dir, tier)
+        self.file = open(path, "ab")
+        self.file.truncate(self.file.tell() - self.file.tell() % ROLLUP_DTYPE.itemsize)
+
+    # Devuelve los registros cerrados (para alimentar al nivel siguiente)
+    def add(self, records):
+        if self.open_record is not None:
+            records = np.concatenate((self.open_record, records))
+        grouped = group(records, self.period)
+        if len(grouped) == 0:
+            return grouped
+        closed, self.open_record = grouped[:-1], grouped[-1:]
+        if len(closed):
+            self.file.write(closed.tobytes())
+        return closed
+
+    def close_open(self):
+        closed = self.open_record if self.open_record is not None else np.zeros(0, dtype=ROLLUP_DTYPE)
+        if len(closed):
+            self.file.write(closed.tobytes())
+        self.open_record = None
+        return closed
+
+    def flush(self):
+        self.file.flush()
+
+    def sync(self):
+        self.file.flush()
+        os.fsync(self.file.fileno())
+
+
+# Todos los niveles de un dispositivo, encadenados: muestras -> 1s -> 1min
+class RollupWriter:
+    def __init__(self, device_dir, tiers=TIERS):
+        self.tiers = [_TierWriter(device_dir, name, period) for name, period in tiers.items()]
+
+    def append(self, t, x, y, z):
+        records = samples_to_records(t, x, y, z)
+        for tier in self.tiers:
+            records = tier.add(records)
+            if len(records) == 0:
+                break
+
+    def flush(self):
+        for tier in self.tiers:
+            tier.flush()
+
+    def sync(self):
+        for tier in self.tiers:
+            tier.sync()
+
+    # Cierra los intervalos abiertos en cascada (fin de sesión)
+    def close(self):
+        pending = np.zeros(0, dtype=ROLLUP_DTYPE)
+        for tier in self.tiers:
+            closed = tier.add(pending) if len(pending) else pending
+            pending = np.concatenate((closed, tier.close_open()))
+        for tier in self.tiers:
+            tier.file.close()
+
+
+# Nivel más grueso cuyo periodo no supera la resolución pedida (None = muestras crudas)
+def pick_tier(resolution_us, available=TIERS):
+    candidates = [(period, name) for name, period in available.items() if period <= resolution_us]
+    return max(candidates)[1] if candidates else None
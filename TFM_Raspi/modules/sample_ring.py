@@ -0,0 +1,99 @@
+import numpy as np
+
+from modules.data_handler import DeviceClock, sample_timestamps_us
+
+# Historial en memoria por dispositivo con tamaño fijo (estructura de arrays).
+# En lugar de listas de dicts {'x','y','z'} (>200 bytes por muestra) cada muestra ocupa
+# sus columnas: t int64, x/y/z int16 y seq uint32.
+#
+# Truco de doble escritura: cada columna mide 2*capacidad y cada muestra se escribe en
+# i y en i+capacidad. Así las últimas n muestras (n <= capacidad) son siempre un tramo
+# contiguo y se devuelven como vistas NumPy sin copiar, aunque den la vuelta al ring.
+
+RING_SECONDS = 600  # Historial por dispositivo (10 min a 100 Hz)
+RING_RATE_HZ = 100
+
+_COLUMNS = (("t", np.int64), ("x", np.int16), ("y", np.int16), ("z", np.int16), ("seq", np.uint32))
+
+
+class SampleRing:
+    def __init__(self, capacity):
+        self.capacity = capacity
+        self.columns = {name: np.zeros(2 * capacity, dtype=dtype) for name, dtype in _COLUMNS}
+        self.head = 0    # Posición (0..capacidad-1) donde irá la siguiente muestra
+        self.total = 0   # Muestras añadidas desde el inicio
+
+    # Memoria reservada, fija desde la creación
+    @property
+    def nbytes(self):
+        return sum(column.nbytes for column in self.columns.values())
+
+    def __len__(self):
+        return min(self.total, self.capacity)
+
+    # Coste proporcional al paquete (no al historial): como mucho 4 copias por columna
+    def append(self, t, x, y, z, seq):
+        n = len(t)
+        if n == 0:
+            return
+        values = {"t": t, "x": x, "y": y, "z": z, "seq": seq}
+        if n > self.capacity:
+            values = {name: v[-self.capacity:] for name, v in values.items()}
+            self.head = (self.head + n - self.capacity) % self.capacity
+            self.total += n - self.capacity
+            n = self.capacity
+
+        cap = self.capacity
+        first = min(n, cap - self.head)  # Tramo hasta el final de la primera mitad
+        for name, column in self.columns.items():
+            v = values[name]
+            column[self.head:self.head + first] = v[:first]
+            column[self.head + cap:self.head + cap + first] = v[:first]
+            if first < n:
+                column[:n - first] = v[first:]
+                column[cap:cap + n - first] = v[first:]
+        self.head = (self.head + n) % cap
+        self.total += n
+
+    # Vistas sin copia de las últimas n muestras. Válidas hasta el siguiente append()
+    # (si hay que conservarlas, copiarlas).
+    def last(self, n):
+        n = min(n, len(self))
+        end = self.head + self.capacity
+        return {name: column[end - n:end] for name, column in self.columns.items()}
+
+    # Vistas de las muestras con t >= t_start (µs)
+    def since(self, t_start):
+        window = self.last(len(self))
+        first = int(np.searchsorted(window["t"], t_start))
+        return {name: view[first:] for name, view in window.items()}
+
+
+# Sink (alias, t_recv_ns, packet): alimenta un ring por dispositivo desde el decodificador.
+# Memoria máxima = dispositivos * capacidad * 2 * 22 bytes (~2,6 MB por dispositivo por defecto).
+class SampleRingSink:
+    def __init__(self, seconds=RING_SECONDS, rate_hz=RING_RATE_HZ):
+        self.capacity = int(seconds * rate_hz)
+        self.rings = {}
+        self.clocks = {}
+
+    def __call__(self, alias, t_recv, packet):
+        ring = self.rings.get(alias)
+        if ring is None:
+            ring = self.rings[alias] = SampleRing(self.capacity)
+            self.clocks[alias] = DeviceClock()
+        t = self.clocks[alias].to_host_us(sample_timestamps_us(packet), t_recv)
+        seq = np.full(len(t), packet["sequence_id"], dtype=np.uint32)
+        ring.append(t, packet["x"], packet["y"], packet["z"], seq)
+
+    # Últimos "seconds" segundos de un dispositivo (vistas, tiempo de la Raspi)
+    def window(self, alias, seconds):
+        ring = self.rings[alias]
+        if len(ring) == 0:
+            return ring.last(0)
+        t_end = int(ring.last(1)["t"][0])
+        return ring.since(t_end - int(seconds * 1_000_000))
+
+    @property
+    def nbytes(self):
+        return sum(ring.nbytes for ring in self.rings.values())
@@ -0,0 +1,143 @@
+import asyncio
+import time
+
+from modules.data_handler import SUPPORTED_VERSIONS
+
+# Escaneo continuo en segundo plano filtrado por el servicio del acelerómetro (0x00FF).
+# Los dispositivos anuncian el UUID del servicio y unos datos de servicio
+# [flags, versión de paquete] (ver TFM_BLE_Dispositivo/main/src/gap.c), así que no hace
+# falta conectar ni fiarse del nombre para saber si son nuestros.
+# La tabla de candidatos (RSSI, último anuncio) está siempre al día: registrar o
+# reconectar no espera a que termine una ventana de escaneo.
+
+ACCEL_SERVICE_UUID = "000000ff-0000-1000-8000-00805f9b34fb"
+ADV_FLAG_LOCKED = 0x01   # Sesión cerrada con una Raspi: solo acepta a esa
+
+CANDIDATE_TTL = 10.0     # s sin anuncios para dar un candidato por perdido (anuncian cada 0,5 s)
+WARMUP_SECONDS = 1.5     # Espera máxima a los primeros anuncios tras arrancar el escáner
+
+
+class Candidate:
+    def __init__(self, device, rssi, flags, version):
+        self.device = device
+        self.rssi = rssi
+        self.flags = flags
+        self.version = version
+        self.last_seen = time.monotonic()
+
+    @property
+    def address(self):
+        return self.device.address
+
+    @property
+    def name(self):
+        return self.device.name
+
+    @property
+    def locked(self):
+        return bool(self.flags & ADV_FLAG_LOCKED)
+
+    def age(self, now=None):
+        return (now or time.monotonic()) - self.last_seen
+
+
+class BackgroundScanner:
+    def __init__(self, transport, service_uuid=ACCEL_SERVICE_UUID, ttl=CANDIDATE_TTL):
+        self.transport = transport  # modules/transport.py (Bleak o simulador)
+        self.service_uuid = service_uuid
+        self.ttl = ttl
+        self.table = {}      # address -> Candidate
+        self.ignored = 0     # Anuncios con el servicio pero de otra versión de paquete
+        self._waiters = {}   # address -> [futuros esperando su anuncio]
+        self._scanner = None
+        self._started = None
+
+    @property
+    def running(self):
+        return self._scanner is not None
+
+    async def start(self):
+        if self._scanner is not None:
+            return
+        # El filtro por UUID lo aplica BlueZ: solo llegan anuncios de nuestros dispositivos
+        self._scanner = self.transport.scanner(self._on_advertisement, [self.service_uuid])
+        await self._scanner.start()
+        self._started = time.monotonic()
+
+    async def stop(self):
+        if self._scanner is None:
+            return
+        scanner, self._scanner = self._scanner, None
+        try:
+            await scanner.stop()
+        except Exception as e:
+            print(f"[Escáner] Error al detener: {e}")
+        for waiters in self._waiters.values():
+            for future in waiters:
+                if not future.done():
+                    future.set_result(None)
+        self._waiters.clear()
+
+    # Callback de Bleak (bucle asyncio): actualiza la tabla y despierta a quien espere
+    def _on_advertisement(self, device, advertisement):
+        if self.service_uuid not in advertisement.service_uuids:
+            return
+        service_data = advertisement.service_data.get(self.service_uuid, b"")
+        flags = service_data[0] if len(service_data) > 0 else 0
+        version = service_data[1] if len(service_data) > 1 else None
+        if version is not None and version not in SUPPORTED_VERSIONS:
+            self.ignored += 1
+            return
+
+        candidate = self.table.get(device.address)
+        if candidate is None:
+            candidate = self.table[device.address] = Candidate(device, advertisement.rssi, flags, version)
+        else:
+            candidate.device = device
+            candidate.rssi = advertisement.rssi
+            candidate.flags = flags
+            candidate.version = version
+            candidate.last_seen = time.monotonic()
+
+        for future in self._waiters.pop(device.address, []):
+            if not future.done():
+                future.set_result(device)
+
+    # Candidatos vistos en los últimos ttl segundos, del más cercano al más lejano.
+    # Recién arrancado el escáner espera un poco a los primeros anuncios.
+    async def candidates(self, exclude=()):
+        if self._started is not None:
+            remaining = WARMUP_SECONDS - (time.monotonic() - self._started)
+            if remaining > 0 and not self.table:
+                await asyncio.sleep(remaining)
+        self.expire()
+        found = [c for c in self.table.values() if c.address not in exclude]
+        return sorted(found, key=lambda c: c.rssi, reverse=True)
+
+    # Dispositivo de una dirección: al momento si se ha visto hace poco, si no espera a su
+    # próximo anuncio (None si no llega en "timeout" segundos)
+    async def wait_for(self, address, timeout):
+        candidate = self.table.get(address)
+        if candidate is not None and candidate.age() < 2 * WARMUP_SECONDS:
+            return candidate.device
+        if self._scanner is None:
+            return await self.transport.find_device(address, timeout)
+
+        future = asyncio.get_running_loop().create_future()
+        self._waiters.setdefault(address, []).append(future)
+        try:
+            return await asyncio.wait_for(future, timeout)
+        except asyncio.TimeoutError:
+            return None
+        finally:
+            waiters = self._waiters.get(address)
+            if waiters is not None and future in waiters:
+                waiters.remove(future)
+                if not waiters:
+                    del self._waiters[address]
+
+    # Borra los candidatos que llevan demasiado sin anunciarse
+    def expire(self):
+        now = time.monotonic()
+        for address in [a for a, c in self.table.items() if c.age(now) >= self.ttl]:
+            del self.table[address]
@@ -0,0 +1,157 @@
+import time
+
+# Secuenciación por dispositivo a partir de sequence_id: detecta paquetes perdidos y
+# duplicados, reordena los que llegan desordenados dentro de una ventana pequeña e inserta
+# en el flujo un registro de hueco explícito justo antes del paquete que lo cierra.
+# Así los consumidores saben cuántas muestras faltan y entre qué instantes, en lugar de
+# pegar el siguiente paquete al anterior como si fueran contiguos.
+#
+# El firmware reinicia sequence_id (y su reloj) en cada suscripción: el llamante pasa un
+# número de suscripción y, cuando cambia, la secuencia vuelve a empezar en 0 (si el primer
+# paquete no es el 0 se anota un hueco inicial). Sin número de suscripción (p.ej. al
+# reanudar el log de captura a mitad) el primer paquete de un dispositivo fija el inicio.
+#
+# Dentro de una conexión BLE las notificaciones llegan en orden, así que la ventana es
+# pequeña: solo cubre el desorden introducido en el host (reintentos, reprocesados).
+
+REORDER_WINDOW = 3     # Paquetes posteriores retenidos como máximo esperando a uno que falta
+REORDER_TIMEOUT = 0.2  # s máximos de espera (se comprueba al llegar el siguiente paquete)
+
+
+# Registro de hueco (tiempos en µs del reloj del dispositivo, como timestamp_start * 1000):
+#   first_seq  primer sequence_id que falta
+#   packets    paquetes que faltan; samples = packets * muestras por paquete
+#   t_start_us instante en que debería haber empezado la primera muestra perdida
+#   t_end_us   primera muestra del paquete que cierra el hueco
+#   ref_us     última muestra de ese paquete (referencia para pasar a tiempo de la Raspi)
+def gap_record(first_seq, packets, samples, t_start_us, t_end_us, ref_us):
+    return {"gap": True, "first_seq": first_seq, "packets": packets, "samples": samples,
+            "t_start_us": t_start_us, "t_end_us": t_end_us, "ref_us": ref_us}
+
+
+def is_gap(record):
+    return record.get("gap", False)
+
+
+class _DeviceSequence:
+    def __init__(self):
+        self.subscription = None
+        self.next_seq = None  # Siguiente sequence_id esperado (None = lo fija el primero)
+        self.last = None      # Último paquete entregado (para fechar el hueco siguiente)
+        self.pending = {}     # seq -> (t_recv, paquete, llegada monotónica)
+        self.packets = 0
+        self.gaps = 0
+        self.lost_packets = 0
+        self.lost_samples = 0
+        self.duplicates = 0   # Repetidos o llegados después de darlos por perdidos
+        self.reordered = 0    # Llegados tarde pero dentro de la ventana
+
+    def as_dict(self):
+        return {"packets": self.packets, "gaps": self.gaps, "lost_packets": self.lost_packets,
+                "lost_samples": self.lost_samples, "duplicates": self.duplicates,
+                "reordered": self.reordered, "pending": len(self.pending)}
+
+
+# push() y flush() devuelven listas de (alias, t_recv_ns, registro) en orden de secuencia,
+# donde registro es el paquete decodificado o un registro de hueco (is_gap).
+# Sin hilos: se usa desde una sola etapa del pipeline o desde el hilo de volcado del log.
+class Sequencer:
+    def __init__(self, window=REORDER_WINDOW, timeout=REORDER_TIMEOUT):
+        self.window = window
+        self.timeout = timeout
+        self.devices = {}  # alias -> _DeviceSequence
+
+    def push(self, alias, t_recv, packet, subscription=None):
+        device = self.devices.get(alias)
+        if device is None:
+            device = self.devices[alias] = _DeviceSequence()
+        out = []
+        if subscription is not None and subscription != device.subscription:
+            self._restart(alias, device, out)
+            device.subscription = subscription
+
+        seq = packet["sequence_id"]
+        if subscription is None and self._restarted(device, packet):
+            self._restart(alias, device, out)
+        if device.next_seq is None:
+            device.next_seq = seq
+        if seq < device.next_seq or seq in device.pending:
+            device.duplicates += 1
+            return out
+        if seq == device.next_seq and device.pending:
+            device.reordered += 1
+        device.pending[seq] = (t_recv, packet, time.monotonic())
+        self._release(alias, device, out, force=False)
+        return out
+
+    # Nueva suscripción sin número (log de captura): entrega lo retenido y la secuencia
+    # vuelve a empezar en 0
+    def restart(self, alias):
+        device = self.devices.get(alias)
+        if device is None:
+            device = self.devices[alias] = _DeviceSequence()
+        out = []
+        self._restart(alias, device, out)
+        return out
+
+    # Sin número de suscripción (logs antiguos): un salto atrás en sequence_id mayor que la
+    # ventana y en el reloj del dispositivo es un reinicio, no un duplicado (como DeviceClock)
+    def _restarted(self, device, packet):
+        last = device.last
+        return (last is not None and packet["sequence_id"] + self.window < device.next_seq
+                and packet["timestamp_start"] < last["timestamp_start"])
+
+    def _restart(self, alias, device, out):
+        self._release(alias, device, out, force=True)
+        device.next_seq = 0
+        device.last = None
+
+    # Entrega todo lo retenido (fin de la escucha o punto de control)
+    def flush(self):
+        out = []
+        for alias, device in self.devices.items():
+            self._release(alias, device, out, force=True)
+        return out
+
+    def _release(self, alias, device, out, force):
+        pending = device.pending
+        while pending:
+            if device.next_seq in pending:
+                t_recv, packet, _ = pending.pop(device.next_seq)
+                out.append((alias, t_recv, packet))
+                device.last = packet
+                device.next_seq += 1
+                device.packets += 1
+                continue
+            first = min(pending)
+            if not force and len(pending) <= self.window and \
+                    time.monotonic() - pending[first][2] <= self.timeout:
+                break
+            # Se da por perdido lo que falta hasta el primer paquete retenido
+            t_recv, packet, _ = pending[first]
+            out.append((alias, t_recv, self._gap(device, first, packet)))
+            device.next_seq = first
+
+    def _gap(self, device, closing_seq, packet):
+        packets = closing_seq - device.next_seq
+        n = len(packet["x"])
+        step_us = 1_000_000 / packet["sample_rate"]
+        t_end_us = packet["timestamp_start"] * 1000
+        if device.last is not None:
+            last = device.last
+            t_start_us = last["timestamp_start"] * 1000 + round(len(last["x"]) * 1_000_000 / last["sample_rate"])
+        else:
+            t_start_us = max(t_end_us - round(packets * n * step_us), 0)
+        device.gaps += 1
+        device.lost_packets += packets
+        device.lost_samples += packets * n
+        return gap_record(device.next_seq, packets, packets * n, t_start_us, t_end_us,
+                          t_end_us + round((n - 1) * step_us))
+
+    def stats(self):
+        return {alias: device.as_dict() for alias, device in self.devices.items()}
+
+    def print_stats(self):
+        for alias, s in sorted(self.stats().items()):
+            print(f" [{alias}] paquetes {s['packets']}, huecos {s['gaps']} ({s['lost_packets']} paquetes, "
+                  f"{s['lost_samples']} muestras), duplicados {s['duplicates']}, reordenados {s['reordered']}")
@@ -0,0 +1,501 @@
+import os
+import queue
+import threading
+import time
+
+import numpy as np
+
+from modules.codec import decode_block
+from modules.data_handler import DeviceClock, sample_timestamps_us
+from modules.rollups import TIERS, RollupWriter, group, pick_tier, read_rollup, samples_to_records, summarize
+
+# Carpeta de sesiones (ignorada por Git): TFM_Raspi/data/raw/<sesión>/<alias>/
+DATA_RAW_DIR = os.path.join(os.path.dirname(os.path.dirname(os.path.abspath(__file__))), "data", "raw")
+
+CHUNK_ROWS = 4096  # Muestras por bloque (~41 s a 100 Hz)
+
+# Rotación de segmentos: se cierra el segmento actual al alcanzar cualquiera de los dos
+SEGMENT_MAX_BYTES = 16 * 1024 * 1024  # ~932 k muestras de ROW_BYTES (~2,6 h a 100 Hz)
+SEGMENT_MAX_SECONDS = 3600.0
+
+# Carpeta de un dispositivo: <alias>/seg_000001/, <alias>/seg_000002/... (segmentos en
+# escritura o cerrados) y <alias>/cseg_000001_000004.tfmc (segmentos ya compactados)
+SEGMENT_PREFIX = "seg_"
+COMPACT_PREFIX = "cseg_"
+COMPACT_EXT = ".tfmc"
+SEALED_FILE = "SEALED"  # Marca de segmento cerrado: ya no se escribe en él
+GAPS_FILE = "gaps.csv"  # Huecos por desconexión del dispositivo
+LOSSES_FILE = "losses.csv"  # Paquetes perdidos según sequence_id (modules/sequencer.py)
+
+# Columnas: un fichero binario por columna, solo se añaden datos al final
+COLUMNS = {
+    "t": np.dtype("<i8"),    # Tiempo de pared de la Raspi (µs desde epoch)
+    "x": np.dtype("<i2"),
+    "y": np.dtype("<i2"),
+    "z": np.dtype("<i2"),
+    "seq": np.dtype("<u4"),  # sequence_id del paquete de la muestra
+}
+
+# Índice disperso: un registro por bloque
+INDEX_FILE = "index.bin"
+INDEX_DTYPE = np.dtype([
+    ("row_start", "<i8"),
+    ("rows", "<i4"),
+    ("t_min", "<i8"),
+    ("t_max", "<i8"),
+    ("seq_min", "<u4"),
+    ("seq_max", "<u4"),
+])
+
+# Índice de un segmento compactado (<nombre>.tfmc.idx): un registro por bloque del códec
+COMPACT_INDEX_DTYPE = np.dtype([
+    ("offset", "<i8"),
+    ("size", "<i4"),
+    ("rows", "<i4"),
+    ("t_min", "<i8"),
+    ("t_max", "<i8"),
+    ("seq_min", "<u4"),
+    ("seq_max", "<u4"),
+])
+
+ROW_BYTES = sum(dtype.itemsize for dtype in COLUMNS.values())
+
+
+def _column_path(device_dir, name):
+    return os.path.join(device_dir, f"{name}.{COLUMNS[name].str[1:]}")
+
+
+def _read_records(path, dtype):
+    if not os.path.exists(path):
+        return np.zeros(0, dtype=dtype)
+    with open(path, "rb") as f:
+        raw = f.read()
+    # Un registro a medias (corte durante la escritura) no cuenta
+    usable = len(raw) - len(raw) % dtype.itemsize
+    return np.frombuffer(raw[:usable], dtype=dtype)
+
+
+# Lee el índice de un segmento (vacío si aún no hay bloques)
+def read_index(segment_dir):
+    return _read_records(os.path.join(segment_dir, INDEX_FILE), INDEX_DTYPE)
+
+
+def read_compact_index(path):
+    return _read_records(path + ".idx", COMPACT_INDEX_DTYPE)
+
+
+def segment_name(number):
+    return f"{SEGMENT_PREFIX}{number:06d}"
+
+
+def compact_name(first, last):
+    return f"{COMPACT_PREFIX}{first:06d}_{last:06d}{COMPACT_EXT}"
+
+
+def is_sealed(segment_dir):
+    return os.path.exists(os.path.join(segment_dir, SEALED_FILE))
+
+
+# Segmentos de un dispositivo en orden: lista de (primero, último, tipo, ruta) con
+# tipo "plain" (carpeta de columnas) o "compact" (fichero del códec).
+# Una carpeta antigua sin segmentos (index.bin directamente en <alias>/) cuenta como el 0.
+def list_segments(device_dir):
+    try:
+        names = os.listdir(device_dir)
+    except FileNotFoundError:
+        return []
+
+    compact, plain = [], []
+    if INDEX_FILE in names:
+        plain.append((0, 0, "plain", device_dir))
+    for name in names:
+        path = os.path.join(device_dir, name)
+        if name.startswith(COMPACT_PREFIX) and name.endswith(COMPACT_EXT):
+            first, last = name[len(COMPACT_PREFIX):-len(COMPACT_EXT)].split("_")
+            compact.append((int(first), int(last), "compact", path))
+        elif name.startswith(SEGMENT_PREFIX) and os.path.isdir(path):
+            number = int(name[len(SEGMENT_PREFIX):])
+            plain.append((number, number, "plain", path))
+
+    # Entre el rename del compactado y el borrado de los originales existen ambos:
+    # mandan los compactados y, entre ellos, el que abarca más (fusión de compactados)
+    covered = [(first, last) for first, last, _, _ in compact]
+    compact = [seg for seg in compact if not any(first <= seg[0] and seg[1] <= last and seg[:2] != (first, last)
+                                                 for first, last in covered)]
+    covered = [(first, last) for first, last, _, _ in compact]
+    plain = [seg for seg in plain if not any(first <= seg[0] <= last for first, last in covered)]
+    return sorted(compact + plain)
+
+
+# Escritor de un segmento. Acumula muestras en un bloque en RAM y al llenarse lo
+# añade a los ficheros de columnas y después al índice. Si el proceso muere, lo que
+# no está en el índice se ignora al leer y se recorta al reabrir.
+class DeviceWriter:
+    def __init__(self, device_dir, chunk_rows=CHUNK_ROWS):
+        os.makedirs(device_dir, exist_ok=True)
+        self.device_dir = device_dir
+        self.chunk_rows = chunk_rows
+
+        index = read_index(device_dir)
+        self.rows_written = int(index["row_start"][-1] + index["rows"][-1]) if len(index) else 0
+
+        self.files = {}
+        for name, dtype in COLUMNS.items():
+            path = _column_path(device_dir, name)
+            f = open(path, "ab")
+            f.truncate(self.rows_written * dtype.itemsize) # Descarta un bloque a medias
+            self.files[name] = f
+        self.index_file = open(os.path.join(device_dir, INDEX_FILE), "ab")
+        self.index_file.truncate(len(index) * INDEX_DTYPE.itemsize)
+
+        self.buffer = {name: np.empty(chunk_rows, dtype=dtype) for name, dtype in COLUMNS.items()}
+        self.fill = 0
+
+    def append(self, t, x, y, z, seq):
+        values = {"t": t, "x": x, "y": y, "z": z, "seq": seq}
+        n = len(t)
+        done = 0
+        while done < n:
+            take = min(n - done, self.chunk_rows - self.fill)
+            for name, column in values.items():
+                self.buffer[name][self.fill:self.fill + take] = column[done:done + take]
+            self.fill += take
+            done += take
+            if self.fill == self.chunk_rows:
+                self.flush()
+
+    # Escribe el bloque actual (aunque esté incompleto) y su entrada de índice
+    def flush(self):
+        if self.fill == 0:
+            return
+        rows = self.fill
+        for name, f in self.files.items():
+            f.write(self.buffer[name][:rows].tobytes())
+            f.flush()
+
+        t = self.buffer["t"][:rows]
+        seq = self.buffer["seq"][:rows]
+        entry = np.array([(self.rows_written, rows, t.min(), t.max(), seq.min(), seq.max())], dtype=INDEX_DTYPE)
+        self.index_file.write(entry.tobytes())
+        self.index_file.flush()
+
+        self.rows_written += rows
+        self.fill = 0
+
+    # Vuelca el bloque actual y fuerza los ficheros a disco (fsync)
+    def sync(self):
+        self.flush()
+        for f in list(self.files.values()) + [self.index_file]:
+            os.fsync(f.fileno())
+
+    def close(self):
+        self.flush()
+        for f in self.files.values():
+            f.close()
+        self.index_file.close()
+
+    # Bytes en disco (y en RAM pendientes) del segmento
+    @property
+    def size_bytes(self):
+        return (self.rows_written + self.fill) * ROW_BYTES
+
+
+# Escritor de un dispositivo con rotación: escribe en seg_NNNNNN/ y al pasar de
+# max_bytes o max_seconds lo sella (fsync + SEALED) y abre el siguiente.
+# Solo los segmentos sellados los tocan la retención y el compactador.
+# Los resúmenes (rollup_1s.bin, rollup_1min.bin) se calculan a la vez y van fuera de
+# los segmentos: sobreviven a la retención de los segmentos antiguos y se borran con la
+# sesión cuando la retención elimina el último.
+class SegmentedWriter:
+    def __init__(self, device_dir, max_bytes=SEGMENT_MAX_BYTES, max_seconds=SEGMENT_MAX_SECONDS,
+                 chunk_rows=CHUNK_ROWS):
+        os.makedirs(device_dir, exist_ok=True)
+        self.device_dir = device_dir
+        self.max_bytes = max_bytes
+        self.max_seconds = max_seconds
+        self.chunk_rows = chunk_rows
+        self.rotations = 0
+        self.rollups = RollupWriter(device_dir)
+
+        # Se continúa en el último segmento si quedó abierto (reinicio tras un corte)
+        segments = list_segments(device_dir)
+        last = max((seg[1] for seg in segments), default=0)
+        plain = [seg for seg in segments if seg[2] == "plain" and seg[1] == last and seg[3] != device_dir]
+        if plain and not is_sealed(plain[0][3]):
+            self._open(last)
+        else:
+            self._open(last + 1)
+
+    def _open(self, number):
+        self.number = number
+        self.writer = DeviceWriter(os.path.join(self.device_dir, segment_name(number)), self.chunk_rows)
+        self.opened_at = time.monotonic()
+
+    def append(self, t, x, y, z, seq):
+        self.writer.append(t, x, y, z, seq)
+        self.rollups.append(t, x, y, z)
+        if (self.writer.size_bytes >= self.max_bytes
+                or time.monotonic() - self.opened_at >= self.max_seconds):
+            self.rotate()
+
+    def _seal(self):
+        self.writer.sync()
+        self.writer.close()
+        with open(os.path.join(self.writer.device_dir, SEALED_FILE), "wb") as f:
+            os.fsync(f.fileno())
+
+    def rotate(self):
+        self._seal()
+        self._open(self.number + 1)
+        self.rotations += 1
+
+    def flush(self):
+        self.writer.flush()
+        self.rollups.flush()
+
+    def sync(self):
+        self.writer.sync()
+        self.rollups.sync()
+
+    # Al terminar la sesión el último segmento también queda sellado
+    def close(self):
+        self._seal()
+        self.rollups.close()
+
+
+# Lector: consultas por rango de tiempo o de secuencia que solo mapean en memoria
+# (np.memmap) los bloques que las cumplen según el índice
+class SessionReader:
+    def __init__(self, session_dir):
+        self.session_dir = session_dir
+
+    def devices(self):
+        return sorted(d for d in os.listdir(self.session_dir)
+                      if os.path.isdir(os.path.join(self.session_dir, d)))
+
+    # Devuelve {columna: array} con las muestras del dispositivo en [t0, t1] y/o [seq0, seq1]
+    # (límites incluidos; None = sin límite). Recorre los segmentos en orden.
+    def query(self, alias, t0=None, t1=None, seq0=None, seq1=None, columns=None):
+        columns = list(columns or COLUMNS)
+        bounds = (t0, t1, seq0, seq1)
+        parts = {name: [] for name in columns}
+        for _, _, kind, path in list_segments(os.path.join(self.session_dir, alias)):
+            if kind == "plain":
+                _query_plain(path, bounds, columns, parts)
+            else:
+                _query_compact(path, bounds, columns, parts)
+
+        return {name: (np.concatenate(parts[name]) if parts[name] else np.zeros(0, dtype=COLUMNS[name]))
+                for name in columns}
+
+    # Resumen por intervalos de "resolution_us" en [t0, t1]: {t, count, x_min, x_max,
+    # x_mean, x_rms, ...} y "tier" con el nivel usado. Se lee el nivel más grueso que
+    # da esa resolución (1 min para un día entero) y solo se va a las muestras crudas
+    # si se pide menos de 1 s. El intervalo aún abierto de la grabación no aparece.
+    def summary(self, alias, t0=None, t1=None, resolution_us=TIERS["1s"]):
+        device_dir = os.path.join(self.session_dir, alias)
+        available = {name: period for name, period in TIERS.items() if read_rollup(device_dir, name) is not None}
+        tier = pick_tier(resolution_us, available)
+
+        if tier is None:
+            raw = self.query(alias, t0, t1, columns=("t", "x", "y", "z"))
+            records = samples_to_records(raw["t"], raw["x"], raw["y"], raw["z"])
+        else:
+            records = read_rollup(device_dir, tier)
+            mask = np.ones(len(records), dtype=bool)
+            if t0 is not None:
+                mask &= records["t"] + available[tier] > t0
+            if t1 is not None:
+                mask &= records["t"] <= t1
+            records = records[mask]
+
+        result = summarize(group(records, resolution_us))
+        result["tier"] = tier or "raw"
+        return result
+
+
+# Bloques candidatos según un índice disperso (rangos t_min/t_max y seq_min/seq_max)
+def _select_blocks(index, bounds):
+    t0, t1, seq0, seq1 = bounds
+    selected = np.ones(len(index), dtype=bool)
+    if t0 is not None:
+        selected &= index["t_max"] >= t0
+    if t1 is not None:
+        selected &= index["t_min"] <= t1
+    if seq0 is not None:
+        selected &= index["seq_max"] >= seq0
+    if seq1 is not None:
+        selected &= index["seq_min"] <= seq1
+    return selected
+
+
+# Filtro exacto dentro de los bloques
+def _row_mask(t, seq, bounds):
+    t0, t1, seq0, seq1 = bounds
+    mask = np.ones(len(t), dtype=bool)
+    if t0 is not None:
+        mask &= t >= t0
+    if t1 is not None:
+        mask &= t <= t1
+    if seq0 is not None:
+        mask &= seq >= seq0
+    if seq1 is not None:
+        mask &= seq <= seq1
+    return mask
+
+
+def _query_plain(segment_dir, bounds, columns, parts):
+    index = read_index(segment_dir)
+    for run in _contiguous_runs(np.flatnonzero(_select_blocks(index, bounds))):
+        row_start = int(index["row_start"][run[0]])
+        rows = int(index["row_start"][run[-1]] + index["rows"][run[-1]]) - row_start
+        mapped = {name: np.memmap(_column_path(segment_dir, name), dtype=COLUMNS[name], mode="r",
+                                  offset=row_start * COLUMNS[name].itemsize, shape=(rows,))
+                  for name in set(columns) | {"t", "seq"}}
+        mask = _row_mask(mapped["t"], mapped["seq"], bounds)
+        for name in columns:
+            parts[name].append(mapped[name][mask])
+
+
+# Segmento compactado: solo se leen y descomprimen los bloques que indica su índice
+def _query_compact(path, bounds, columns, parts):
+    index = read_compact_index(path)
+    selected = np.flatnonzero(_select_blocks(index, bounds))
+    if len(selected) == 0:
+        return
+    with open(path, "rb") as f:
+        for i in selected:
+            f.seek(int(index["offset"][i]))
+            block, _ = decode_block(f.read(int(index["size"][i])))
+            mask = _row_mask(block["t"], block["seq"], bounds)
+            for name in columns:
+                parts[name].append(block[name][mask])
+
+
+# Agrupa índices consecutivos: [1,2,3,7,8] -> [[1,2,3],[7,8]]
+def _contiguous_runs(indices):
+    if len(indices) == 0:
+        return []
+    breaks = np.flatnonzero(np.diff(indices) != 1) + 1
+    return np.split(indices, breaks)
+
+
+# Sink para el pipeline (o factory de consumidor en modules/multiproc.py):
+# guarda cada paquete decodificado en la sesión actual
+class SessionStoreSink:
+    def __init__(self, root=DATA_RAW_DIR, session=None, max_bytes=SEGMENT_MAX_BYTES,
+                 max_seconds=SEGMENT_MAX_SECONDS):
+        self.session_dir = os.path.join(root, session or time.strftime("%Y%m%d_%H%M%S"))
+        self.max_bytes = max_bytes
+        self.max_seconds = max_seconds
+        self.writers = {}
+        self.clocks = {}
+
+    def __call__(self, alias, t_recv, packet):
+        writer = self.writers.get(alias)
+        if writer is None:
+            writer = self.writers[alias] = SegmentedWriter(os.path.join(self.session_dir, alias),
+                                                           self.max_bytes, self.max_seconds)
+            self.clocks[alias] = DeviceClock()
+        t = self.clocks[alias].to_host_us(sample_timestamps_us(packet), t_recv)
+        seq = np.full(len(t), packet["sequence_id"], dtype=np.uint32)
+        writer.append(t, packet["x"], packet["y"], packet["z"], seq)
+
+    # Intervalo sin datos por una desconexión: se anota en <alias>/gaps.csv (µs, tiempo de pared)
+    def mark_gap(self, alias, t_start_ns, t_end_ns):
+        device_dir = os.path.join(self.session_dir, alias)
+        os.makedirs(device_dir, exist_ok=True)
+        path = os.path.join(device_dir, GAPS_FILE)
+        new = not os.path.exists(path)
+        with open(path, "a", encoding="utf-8") as f:
+            if new:
+                f.write("inicio_us,fin_us\n")
+            f.write(f"{DeviceClock.mono_to_wall_ns(t_start_ns) // 1000},{DeviceClock.mono_to_wall_ns(t_end_ns) // 1000}\n")
+
+    # Paquetes perdidos (registro de hueco del Sequencer, antes del paquete que lo cierra):
+    # se anotan en <alias>/losses.csv con el intervalo en µs de tiempo de pared, como los datos
+    def mark_loss(self, alias, t_recv, gap):
+        clock = self.clocks.get(alias)
+        if clock is None:
+            clock = self.clocks[alias] = DeviceClock()
+        t_start, t_end, _ = clock.to_host_us(
+            np.array([gap["t_start_us"], gap["t_end_us"], gap["ref_us"]], dtype=np.int64), t_recv)
+        device_dir = os.path.join(self.session_dir, alias)
+        os.makedirs(device_dir, exist_ok=True)
+        path = os.path.join(device_dir, LOSSES_FILE)
+        new = not os.path.exists(path)
+        with open(path, "a", encoding="utf-8") as f:
+            if new:
+                f.write("inicio_us,fin_us,primer_seq,paquetes,muestras\n")
+            f.write(f"{t_start},{t_end},{gap['first_seq']},{gap['packets']},{gap['samples']}\n")
+
+    # Todo lo recibido hasta ahora queda en disco (lo usa el punto de control del log de captura)
+    def sync(self):
+        for writer in self.writers.values():
+            writer.sync()
+
+    def close(self):
+        for writer in self.writers.values():
+            writer.close()
+        self.writers.clear()
+
+
+# Envoltorio que saca un sink del bucle asyncio: __call__ solo encola (nunca bloquea) y
+# un hilo hace la escritura. Si la tarjeta SD se atasca se llena la cola y se descartan
+# paquetes (contados en "dropped") en lugar de frenar las notificaciones del BLEManager.
+class BackgroundSink:
+    QUEUE_SIZE = 4096  # Paquetes (~23 min de un dispositivo a 100 Hz con 35 muestras/paquete)
+
+    def __init__(self, sink, maxsize=QUEUE_SIZE, name="store"):
+        self.sink = sink
+        self.dropped = 0
+        self._queue = queue.Queue(maxsize)
+        self._thread = threading.Thread(target=self._run, name=f"tfm-{name}", daemon=True)
+        self._thread.start()
+
+    def __call__(self, alias, t_recv, packet):
+        try:
+            self._queue.put_nowait((self.sink, (alias, t_recv, packet)))
+        except queue.Full:
+            self.dropped += 1
+
+    def mark_gap(self, alias, t_start_ns, t_end_ns):
+        try:
+            self._queue.put_nowait((self.sink.mark_gap, (alias, t_start_ns, t_end_ns)))
+        except queue.Full:
+            print(f"[{self._thread.name}] Cola llena: no se pudo anotar el hueco de {alias}")
+
+    def mark_loss(self, alias, t_recv, gap):
+        try:
+            self._queue.put_nowait((self.sink.mark_loss, (alias, t_recv, gap)))
+        except queue.Full:
+            print(f"[{self._thread.name}] Cola llena: no se pudo anotar la pérdida de {alias}")
+
+    def _run(self):
+        while True:
+            item = self._queue.get()
+            try:
+                if item is None:
+                    return
+                func, args = item
+                func(*args)
+            except Exception as e:
+                print(f"[{self._thread.name}] Error guardando paquete: {e}")
+            finally:
+                self._queue.task_done()
+
+    @property
+    def depth(self):
+        return self._queue.qsize()
+
+    # Espera a que se escriba lo encolado y lo fuerza a disco
+    def sync(self):
+        self._queue.join()
+        self.sink.sync()
+
+    def close(self):
+        self._queue.put(None)
+        self._thread.join()
+        self.sink.close()
+        if self.dropped:
+            print(f"[{self._thread.name}] Paquetes descartados por almacenamiento lento: {self.dropped}")
@@ -0,0 +1,205 @@
+import os
+import threading
+from multiprocessing import resource_tracker, shared_memory
+
+import numpy as np
+
+from modules.data_handler import sample_timestamps_us
+
+# Un segmento de memoria compartida POSIX por dispositivo: /dev/shm/tfm_ring_<alias>
+SHM_PREFIX = "tfm_ring_"
+RING_CAPACITY = 1 << 15  # Muestras por dispositivo (~5,5 min a 100 Hz, ~450 KB)
+
+# Cabecera: int64[8]
+_MAGIC = 0x54464D52494E4701  # "TFMRING" + versión 1
+_H_MAGIC, _H_CAPACITY, _H_BEGIN, _H_END = range(4)
+_HEADER_WORDS = 8
+
+# Columnas tras la cabecera: tiempo (µs, reloj del dispositivo) y ejes int16
+_COLUMNS = (("t", np.int64), ("x", np.int16), ("y", np.int16), ("z", np.int16))
+
+
+# Barrera de memoria entre las escrituras de los datos y las de los contadores (y entre
+# sus lecturas). Las asignaciones de NumPy no ordenan nada: en los núcleos ARM de la Raspi
+# otro proceso podría ver END actualizado antes que los datos. Python no expone una barrera
+# explícita, pero soltar un lock y volver a cogerlo (operaciones atómicas release + acquire
+# en CPython) equivale a una barrera completa en ARMv8 y x86. El lock es nuevo en cada
+# llamada, así que nunca hay espera y se puede llamar a la vez desde cualquier hilo
+# (varios lectores, o un lector junto a ShmRingSink, en el mismo proceso).
+def _fence():
+    lock = threading.Lock()
+    lock.acquire()
+    lock.release()
+    lock.acquire()
+
+
+def _segment_name(alias):
+    return SHM_PREFIX + alias
+
+
+def _layout(capacity):
+    offset = _HEADER_WORDS * 8
+    layout = {}
+    for name, dtype in _COLUMNS:
+        layout[name] = (offset, np.dtype(dtype))
+        offset += capacity * np.dtype(dtype).itemsize
+    return layout, offset
+
+
+# Vistas NumPy sobre el segmento (sin copias)
+def _map(shm, capacity):
+    header = np.ndarray((_HEADER_WORDS,), dtype=np.int64, buffer=shm.buf)
+    layout, _ = _layout(capacity)
+    columns = {name: np.ndarray((capacity,), dtype=dtype, buffer=shm.buf, offset=offset)
+               for name, (offset, dtype) in layout.items()}
+    return header, columns
+
+
+# Rings publicados actualmente (solo Linux, donde /dev/shm es visible)
+def list_rings():
+    try:
+        return sorted(name[len(SHM_PREFIX):] for name in os.listdir("/dev/shm") if name.startswith(SHM_PREFIX))
+    except FileNotFoundError:
+        return []
+
+
+# Productor único de un dispositivo.
+# Protocolo sin locks (tipo seqlock) con dos contadores monótonos de muestras escritas:
+#   BEGIN se adelanta ANTES de escribir los datos y END se actualiza DESPUÉS (con una
+#   barrera _fence() a cada lado de los datos; el lector pone las suyas en orden inverso).
+# Un lector copia [pos, END) y luego relee BEGIN: lo anterior a BEGIN - capacidad
+# puede haberse sobrescrito durante la copia y se descarta como pérdida (overrun).
+class ShmRingWriter:
+    def __init__(self, alias, capacity=RING_CAPACITY):
+        self.alias = alias
+        self.capacity = capacity
+        _, size = _layout(capacity)
+        try:
+            self.shm = shared_memory.SharedMemory(name=_segment_name(alias), create=True, size=size)
+        except FileExistsError:
+            # Restos de una ejecución anterior: se recrea desde cero
+            old = shared_memory.SharedMemory(name=_segment_name(alias))
+            old.close()
+            old.unlink()
+            self.shm = shared_memory.SharedMemory(name=_segment_name(alias), create=True, size=size)
+        self.header, self.columns = _map(self.shm, capacity)
+        self.header[:] = 0
+        self.header[_H_CAPACITY] = capacity
+        self.header[_H_MAGIC] = _MAGIC # Último: el segmento ya está listo para lectores
+
+    def write(self, t, x, y, z):
+        n = len(t)
+        if n == 0:
+            return
+        if n > self.capacity: # Solo caben las últimas "capacity" muestras
+            t, x, y, z = t[-self.capacity:], x[-self.capacity:], y[-self.capacity:], z[-self.capacity:]
+        written = int(self.header[_H_END])
+        end = written + n
+        self.header[_H_BEGIN] = end
+        _fence()
+
+        start = (end - len(t)) % self.capacity
+        first = min(len(t), self.capacity - start) # Tramo hasta el final del buffer
+        for name, values in (("t", t), ("x", x), ("y", y), ("z", z)):
+            column = self.columns[name]
+            column[start:start + first] = values[:first]
+            column[:len(t) - first] = values[first:]
+
+        _fence()
+        self.header[_H_END] = end
+
+    def close(self):
+        del self.header, self.columns
+        self.shm.close()
+        self.shm.unlink()
+
+
+# Consumidor: cualquier proceso local puede engancharse a un dispositivo por su alias
+class ShmRingReader:
+    def __init__(self, alias, from_start=False):
+        self.alias = alias
+        self.shm = shared_memory.SharedMemory(name=_segment_name(alias))
+        # Python registra el segmento para borrarlo al salir aunque no lo haya creado: se evita
+        resource_tracker.unregister(self.shm._name, "shared_memory")
+        capacity = int(np.ndarray((_HEADER_WORDS,), dtype=np.int64, buffer=self.shm.buf)[_H_CAPACITY])
+        self.capacity = capacity
+        self.header, self.columns = _map(self.shm, capacity)
+        if self.header[_H_MAGIC] != _MAGIC:
+            raise ValueError(f"El segmento de {alias} no es un ring TFM válido")
+        end = int(self.header[_H_END])
+        self.position = max(0, end - capacity) if from_start else end
+        self.lost = 0 # Muestras perdidas por no leer a tiempo
+
+    # Copia las muestras nuevas desde la última lectura.
+    # Devuelve (t, x, y, z, perdidas) y avanza la posición del lector.
+    def read_new(self):
+        end = int(self.header[_H_END])
+        lost = 0
+        if end - self.position > self.capacity:
+            lost = end - self.capacity - self.position
+            self.position = end - self.capacity
+
+        _fence()
+        data = {name: self._copy(column, self.position, end) for name, column in self.columns.items()}
+        _fence()
+
+        # El productor pudo adelantarnos mientras copiábamos
+        oldest_valid = int(self.header[_H_BEGIN]) - self.capacity
+        if oldest_valid > self.position:
+            skip = min(oldest_valid - self.position, end - self.position)
+            data = {name: values[skip:] for name, values in data.items()}
+            lost += skip
+
+        self.position = end
+        self.lost += lost
+        return data["t"], data["x"], data["y"], data["z"], lost
+
+    # Vistas sin copia de las últimas n muestras: lista de 1 o 2 tramos {columna: vista}
+    # y el índice absoluto de la primera muestra. Tras usarlas hay que llamar a
+    # still_valid(indice): si devuelve False el productor las sobrescribió entretanto.
+    def latest_views(self, n):
+        end = int(self.header[_H_END])
+        _fence()
+        n = min(n, end, self.capacity)
+        first = end - n
+        start = first % self.capacity
+        head = min(n, self.capacity - start)
+        spans = [{name: column[start:start + head] for name, column in self.columns.items()}]
+        if head < n:
+            spans.append({name: column[:n - head] for name, column in self.columns.items()})
+        return spans, first
+
+    def still_valid(self, first_index):
+        _fence()
+        return first_index >= int(self.header[_H_BEGIN]) - self.capacity
+
+    def _copy(self, column, start, end):
+        a, b = start % self.capacity, end % self.capacity
+        if end - start == 0:
+            return column[:0].copy()
+        if a < b:
+            return column[a:b].copy()
+        return np.concatenate((column[a:], column[:b]))
+
+    def close(self):
+        del self.header, self.columns
+        self.shm.close()
+
+
+# Sink para el pipeline (o factory para un consumidor de modules/multiproc.py):
+# publica cada paquete decodificado en el ring de su dispositivo
+class ShmRingSink:
+    def __init__(self, capacity=RING_CAPACITY):
+        self.capacity = capacity
+        self.writers = {}
+
+    def __call__(self, alias, t_recv, packet):
+        writer = self.writers.get(alias)
+        if writer is None:
+            writer = self.writers[alias] = ShmRingWriter(alias, self.capacity)
+        writer.write(sample_timestamps_us(packet), packet["x"], packet["y"], packet["z"])
+
+    def close(self):
+        for writer in self.writers.values():
+            writer.close()
+        self.writers.clear()
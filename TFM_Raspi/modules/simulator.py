@@ -0,0 +1,342 @@
+import asyncio
+import struct
+import time
+from collections import deque
+
+import numpy as np
+
+from modules.ble_manager import CHARACTERISTIC_UUID, CREDIT_CHARACTERISTIC_UUID
+from modules.packet_schema import (BITFIELDS, CH_XYZ, ENC_RAW_I16, FORMAT_VERSION, HEADER_DTYPE, PACKET_DTYPE,
+                                   RANGE_2G, SAMPLES_PER_PACKET)
+from modules.scanner import ACCEL_SERVICE_UUID, ADV_FLAG_LOCKED
+
+# Pulseras virtuales dentro del proceso para probar la Raspi sin hardware ni BlueZ.
+# Imitan al firmware (TFM_BLE_Dispositivo/main/src): paquetes accel_packet_t idénticos
+# byte a byte, anuncios con el servicio 0x00FF y [flags, versión], contadores (secuencia y
+# tiempo) a cero en cada suscripción, control de flujo por créditos con retención de 16
+# paquetes y descarte del más antiguo, y la marca notify_offset_ms al entregar cada paquete.
+# Además: jitter de entrega, pérdida de paquetes (hueco en la secuencia; no consumen
+# crédito, como un descarte en el dispositivo) y desconexiones aleatorias con un tiempo
+# sin anunciarse.
+
+ADV_INTERVAL = 0.5            # s entre anuncios (como el firmware)
+CONNECT_LATENCY = 0.05        # s que tarda connect()
+HOLDBACK_PACKETS = 16         # ACCEL_HOLDBACK_PACKETS del firmware
+TICK_SECONDS = 0.02           # Con tasas altas los paquetes se generan en ráfagas por tick
+_POOL_PACKETS = 64            # Paquetes de muestras pregenerados que se reutilizan en ciclo
+_TIMESTAMP_POS = HEADER_DTYPE.fields["timestamp_start"][1]
+_NOTIFY_OFFSET_POS = HEADER_DTYPE.fields["notify_offset_ms"][1]
+
+
+# Señal tipo acelerómetro al caminar (cuentas a ±2g: 1g = 16384 / 2): gravedad en Z,
+# oscilación de ~2 Hz con armónicos y ruido del sensor
+def realistic_signal(n_samples, seed=0, rate=100):
+    rng = np.random.default_rng(seed)
+    t = np.arange(n_samples) / rate
+    one_g = 8192
+    step = 2 * np.pi * 1.9 * t
+    x = 0.30 * one_g * np.sin(step) + 0.10 * one_g * np.sin(2 * step + 0.5)
+    y = 0.15 * one_g * np.sin(step + 1.2)
+    z = one_g + 0.40 * one_g * np.abs(np.sin(step / 2))
+    noise = rng.normal(0, 12, size=(3, n_samples))
+    return [np.clip(axis + n, -32768, 32767).astype(np.int16) for axis, n in zip((x, y, z), noise)]
+
+
+def _packet_pool(rate_hz, seed):
+    pool = np.zeros(_POOL_PACKETS, dtype=PACKET_DTYPE)
+    header = pool["header"]
+    header["format"] = (FORMAT_VERSION << BITFIELDS["format"]["version"][0]) | ENC_RAW_I16
+    header["channels"] = (RANGE_2G << BITFIELDS["channels"]["range"][0]) | CH_XYZ
+    header["sample_rate_hz"] = rate_hz
+    header["sample_count"] = SAMPLES_PER_PACKET
+    for axis, values in zip(("x", "y", "z"), realistic_signal(_POOL_PACKETS * SAMPLES_PER_PACKET, seed, rate_hz)):
+        pool["samples"][axis] = values.reshape(_POOL_PACKETS, SAMPLES_PER_PACKET)
+    return pool
+
+
+class SimulatedWearable:
+    def __init__(self, address, name, rate_hz=100, jitter_ms=5.0, loss=0.0, disconnect_interval=None,
+                 downtime=2.0, rssi=-60, seed=0):
+        self.address = address
+        self.name = name
+        self.rate_hz = rate_hz
+        self.jitter = jitter_ms / 1000
+        self.loss = loss                                # Probabilidad de perder un paquete
+        self.disconnect_interval = disconnect_interval  # s medios entre desconexiones (None = nunca)
+        self.downtime = downtime                        # s sin anunciarse tras desconectarse
+        self.rssi = rssi
+        self.rng = np.random.default_rng(seed)
+        self.pool = _packet_pool(rate_hz, seed)
+
+        self.advertising = True
+        self.locked = False     # Tras la primera conexión (ADV_FLAG_LOCKED)
+        self.client = None
+        self._notify = None
+        self._task = None
+        self._credits = 0
+        self._holdback = []
+        self._seq = 0
+        self._t0 = 0.0
+        self._in_flight = deque()  # (instante de entrega, bytes) en orden de envío
+        self._delivery = None      # Callback programado que vacía _in_flight
+        # Contadores para las pruebas de carga
+        self.generated = 0      # Paquetes completados mientras había suscripción
+        self.sent = 0           # Notificados (consumen crédito)
+        self.lost = 0           # Perdidos (pérdida simulada)
+        self.dropped = 0        # Descartados sin créditos (retención llena)
+        self.disconnects = 0
+
+    # ---- Lado del cliente (SimulatedClient) ----
+
+    def attach(self, client):
+        self.client = client
+        self.advertising = False
+        self.locked = True
+
+    def subscribe(self, callback):
+        self._notify = callback
+        # Como accel_reset_counters() y credits_reset() en gatt_svr_subscribe_cb
+        self._seq = 0
+        self._t0 = time.monotonic()
+        self._credits = 0
+        self._holdback = []
+        if self._task is None:
+            self._task = asyncio.get_running_loop().create_task(self._run())
+
+    def unsubscribe(self):
+        self._notify = None
+        self._clear_in_flight()
+        if self._task is not None:
+            self._task.cancel()
+            self._task = None
+
+    # Lo que estaba en el aire con la suscripción anterior ya no llega
+    def _clear_in_flight(self):
+        self._in_flight.clear()
+        if self._delivery is not None:
+            self._delivery.cancel()
+            self._delivery = None
+
+    def grant(self, amount):
+        self._credits = min(self._credits + amount, 0xFFFF)
+        self._flush_holdback()
+
+    # Fin de la conexión (pedido por el cliente o por el propio dispositivo)
+    def detach(self):
+        self.unsubscribe()
+        self.client = None
+        self.advertising = True  # El firmware vuelve a anunciarse al desconectarse
+
+    def _advertise_again(self):
+        if self.client is None:
+            self.advertising = True
+
+    # ---- Firmware simulado ----
+
+    # Paquete cuya primera muestra se tomó en "first_sample" (time.monotonic())
+    def _packet(self, first_sample):
+        record = self.pool[self._seq % _POOL_PACKETS:self._seq % _POOL_PACKETS + 1].copy()
+        record["header"]["sequence_id"] = self._seq
+        record["header"]["timestamp_start"] = int((first_sample - self._t0) * 1000) & 0xFFFFFFFF
+        self._seq += 1
+        return bytearray(record.tobytes())
+
+    def _notify_packet(self, data):
+        self.sent += 1
+        self._credits -= 1
+        # Como notify_packet(): ms desde la primera muestra hasta entregarlo (saturado a 16 bits)
+        waited_ms = int((time.monotonic() - self._t0) * 1000) - struct.unpack_from("<I", data, _TIMESTAMP_POS)[0]
+        struct.pack_into("<H", data, _NOTIFY_OFFSET_POS, min(max(waited_ms, 0), 0xFFFF))
+        # Entrega con retraso aleatorio sin adelantar a la anterior (BLE no reordena): cola
+        # FIFO por dispositivo vaciada por un único callback. Varios call_at con el mismo
+        # instante no se ejecutan necesariamente en orden.
+        loop = asyncio.get_running_loop()
+        at = loop.time() + abs(self.rng.normal(0, self.jitter))
+        if self._in_flight:
+            at = max(at, self._in_flight[-1][0])
+        self._in_flight.append((at, data))
+        if self._delivery is None:
+            self._delivery = loop.call_at(at, self._deliver)
+
+    def _deliver(self):
+        loop = asyncio.get_running_loop()
+        now = loop.time()
+        while self._in_flight and self._in_flight[0][0] <= now:
+            _, data = self._in_flight.popleft()
+            if self._notify is not None:
+                self._notify(None, bytearray(data))
+        self._delivery = loop.call_at(self._in_flight[0][0], self._deliver) if self._in_flight else None
+
+    def _flush_holdback(self):
+        while self._holdback and self._credits > 0 and self._notify is not None:
+            self._notify_packet(self._holdback.pop(0))
+
+    # send_accel_batch(): primero los retenidos; sin créditos se retiene (descarta el más antiguo)
+    def _send(self, data):
+        self.generated += 1
+        if self.rng.random() < self.loss:
+            self.lost += 1
+            return
+        self._flush_holdback()
+        if not self._holdback and self._credits > 0:
+            self._notify_packet(data)
+            return
+        if len(self._holdback) == HOLDBACK_PACKETS:
+            self._holdback.pop(0)
+            self.dropped += 1
+        self._holdback.append(data)
+
+    async def _run(self):
+        period = SAMPLES_PER_PACKET / self.rate_hz
+        tick = max(period, TICK_SECONDS)
+        start = self._t0
+        produced = 0
+        min_sleep = TICK_SECONDS if period < TICK_SECONDS else 0
+        while self._notify is not None:
+            # Un paquete sale al tomar su última muestra, como en el firmware
+            ready_at = start + produced * period + (SAMPLES_PER_PACKET - 1) / self.rate_hz
+            await asyncio.sleep(max(ready_at - time.monotonic(), min_sleep))
+            due = int((time.monotonic() - start + 1 / self.rate_hz) / period)
+            for index in range(produced, due):
+                self._send(self._packet(start + index * period))
+            produced = due
+            if self.disconnect_interval and self.rng.random() < tick / self.disconnect_interval:
+                self._drop_link()
+                return
+
+    # Desconexión provocada por el dispositivo (reinicio, fuera de alcance...)
+    def _drop_link(self):
+        client = self.client
+        self.disconnects += 1
+        self._task = None
+        self._notify = None
+        self._clear_in_flight()
+        self.client = None
+        asyncio.get_running_loop().call_later(self.downtime, self._advertise_again)
+        if client is not None:
+            client._lost()
+
+
+class _Services:
+    def get_characteristic(self, uuid):
+        return uuid if uuid.upper() in (CHARACTERISTIC_UUID, CREDIT_CHARACTERISTIC_UUID) else None
+
+
+class SimulatedClient:
+    def __init__(self, transport, device, disconnected_callback=None):
+        self.address = getattr(device, "address", device)
+        self._wearable = transport.devices.get(self.address)
+        self._disconnected_callback = disconnected_callback
+        self.is_connected = False
+        self.services = _Services()
+
+    async def connect(self):
+        await asyncio.sleep(CONNECT_LATENCY)
+        if self._wearable is None or not self._wearable.advertising:
+            raise ConnectionError(f"{self.address}: dispositivo no disponible")
+        self._wearable.attach(self)
+        self.is_connected = True
+
+    async def disconnect(self):
+        if self.is_connected:
+            self.is_connected = False
+            self._wearable.detach()
+            self._callback()
+
+    def _lost(self):
+        self.is_connected = False
+        self._callback()
+
+    def _callback(self):
+        if self._disconnected_callback is not None:
+            asyncio.get_running_loop().call_soon(self._disconnected_callback, self)
+
+    async def start_notify(self, uuid, callback):
+        self._check()
+        self._wearable.subscribe(callback)
+
+    async def stop_notify(self, uuid):
+        self._check()
+        self._wearable.unsubscribe()
+
+    async def write_gatt_char(self, uuid, data, response=False):
+        self._check()
+        if uuid == CREDIT_CHARACTERISTIC_UUID:
+            self._wearable.grant(struct.unpack("<H", data)[0])
+
+    def _check(self):
+        if not self.is_connected:
+            raise ConnectionError(f"{self.address}: no conectado")
+
+
+class _Device:
+    def __init__(self, address, name):
+        self.address = address
+        self.name = name
+
+
+class _Advertisement:
+    def __init__(self, wearable):
+        self.rssi = wearable.rssi
+        self.local_name = wearable.name
+        self.service_uuids = [ACCEL_SERVICE_UUID]
+        self.service_data = {ACCEL_SERVICE_UUID: bytes((ADV_FLAG_LOCKED if wearable.locked else 0, FORMAT_VERSION))}
+
+
+class SimulatedScanner:
+    def __init__(self, transport, detection_callback, service_uuids):
+        self.transport = transport
+        self.detection_callback = detection_callback
+        self._task = None
+
+    async def start(self):
+        self._task = asyncio.get_running_loop().create_task(self._run())
+
+    async def stop(self):
+        if self._task is not None:
+            self._task.cancel()
+            self._task = None
+
+    async def _run(self):
+        while True:
+            for wearable in self.transport.devices.values():
+                if wearable.advertising:
+                    self.detection_callback(_Device(wearable.address, wearable.name), _Advertisement(wearable))
+            await asyncio.sleep(ADV_INTERVAL)
+
+
+# Transporte (ver modules/transport.py) con pulseras virtuales en lugar de Bluetooth
+class SimulatedTransport:
+    name = "simulador"
+
+    def __init__(self, wearables):
+        self.devices = {w.address: w for w in wearables}
+
+    # n pulseras iguales con direcciones 02:00:00:00:00:NN (administradas localmente)
+    @classmethod
+    def fleet(cls, n, seed=0, **options):
+        return cls([SimulatedWearable(f"02:00:00:00:{i >> 8:02X}:{i & 0xFF:02X}", f"Sim_{i + 1}",
+                                      rssi=-45 - i % 40, seed=seed + i, **options) for i in range(n)])
+
+    def client(self, device, disconnected_callback):
+        return SimulatedClient(self, device, disconnected_callback)
+
+    def scanner(self, detection_callback, service_uuids):
+        return SimulatedScanner(self, detection_callback, service_uuids)
+
+    async def find_device(self, address, timeout):
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            wearable = self.devices.get(address)
+            if wearable is not None and wearable.advertising:
+                return _Device(wearable.address, wearable.name)
+            await asyncio.sleep(ADV_INTERVAL)
+        return None
+
+    async def remove_bond(self, mac):
+        pass
+
+    # Totales de todas las pulseras (pruebas de carga)
+    def totals(self):
+        keys = ("generated", "sent", "lost", "dropped", "disconnects")
+        return {key: sum(getattr(w, key) for w in self.devices.values()) for key in keys}
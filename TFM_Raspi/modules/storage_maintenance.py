@@ -0,0 +1,329 @@
+import os
+import shutil
+import threading
+import time
+
+import numpy as np
+
+from modules.codec import BLOCK_ROWS, encode_block
+from modules.session_store import (COLUMNS, COMPACT_EXT, COMPACT_INDEX_DTYPE, COMPACT_PREFIX, DATA_RAW_DIR,
+                                   ROW_BYTES, SEGMENT_PREFIX, _column_path, compact_name, is_sealed,
+                                   list_segments, read_compact_index, read_index)
+
+# Mantenimiento del almacén en segundo plano (nunca en el camino de recepción):
+#   - compactación: segmentos cerrados consecutivos -> un fichero del códec con índice nuevo;
+#     los compactados vecinos se van fusionando hasta COMPACT_TARGET_BYTES
+#   - retención: borra los segmentos cerrados más antiguos por edad o por espacio total, y
+#     la sesión entera (resúmenes, huecos, log de captura) cuando se queda sin segmentos
+# Toda la E/S pasa por un limitador de ancho de banda para no saturar la tarjeta SD.
+
+MAINTENANCE_INTERVAL = 60.0             # Segundos entre pasadas
+THROTTLE_BYTES_PER_SEC = 4 * 1024 * 1024
+COMPACT_TARGET_BYTES = 64 * 1024 * 1024 # Datos sin comprimir máximos por segmento compactado
+RETENTION_MAX_AGE = 30 * 86400          # Segundos (30 días)
+RETENTION_MAX_BYTES = 8 * 1024**3       # 8 GB para todas las sesiones
+
+
+# Limitador de E/S: consume(n) duerme lo necesario para no pasar de "rate" bytes/s
+class Throttle:
+    def __init__(self, rate=THROTTLE_BYTES_PER_SEC):
+        self.rate = rate
+        self._next_free = time.monotonic()
+
+    def consume(self, n):
+        if not self.rate:
+            return
+        now = time.monotonic()
+        self._next_free = max(self._next_free, now) + n / self.rate
+        delay = self._next_free - now
+        if delay > 0:
+            time.sleep(delay)
+
+
+def _segment_bytes(kind, path):
+    if kind == "compact":
+        return sum(os.path.getsize(p) for p in (path, path + ".idx") if os.path.exists(p))
+    return sum(os.path.getsize(os.path.join(path, name)) for name in os.listdir(path))
+
+
+# Último instante (µs desde epoch) con datos en un segmento, según su índice
+def _segment_t_max(kind, path):
+    index = read_compact_index(path) if kind == "compact" else read_index(path)
+    return int(index["t_max"].max()) if len(index) else None
+
+
+# Carpetas de sesión
+def _session_dirs(root):
+    sessions = sorted(os.listdir(root)) if os.path.isdir(root) else []
+    return [os.path.join(root, s) for s in sessions if os.path.isdir(os.path.join(root, s))]
+
+
+# Carpetas de dispositivo de una sesión o, con all_sessions, de todas las de "root"
+def _device_dirs(root, all_sessions=True):
+    result = []
+    for session_dir in _session_dirs(root) if all_sessions else [root]:
+        for alias in sorted(os.listdir(session_dir)):
+            device_dir = os.path.join(session_dir, alias)
+            if os.path.isdir(device_dir):
+                result.append(device_dir)
+    return result
+
+
+# Bytes y última modificación de todos los ficheros bajo "path"
+def _tree_usage(path):
+    total, newest = 0, 0.0
+    for dirpath, _, names in os.walk(path):
+        for name in names:
+            try:
+                st = os.stat(os.path.join(dirpath, name))
+            except FileNotFoundError:
+                continue  # Borrado entre medias (compactación, rotación del log)
+            total += st.st_size
+            newest = max(newest, st.st_mtime)
+    return total, newest
+
+
+# ------------------------------ COMPACTACIÓN ------------------------------
+
+# Restos de una compactación interrumpida: temporales y originales ya compactados
+# (segmentos y compactados menores dentro de uno mayor)
+def _cleanup(device_dir):
+    names = os.listdir(device_dir)
+    covered = []
+    for name in names:
+        path = os.path.join(device_dir, name)
+        if name.endswith(".tmp"):
+            os.remove(path)
+        elif name.startswith(COMPACT_PREFIX) and name.endswith(COMPACT_EXT):
+            first, last = name[len(COMPACT_PREFIX):-len(COMPACT_EXT)].split("_")
+            covered.append((int(first), int(last)))
+    for name in names:
+        if name.startswith(SEGMENT_PREFIX):
+            number = int(name[len(SEGMENT_PREFIX):])
+            if any(first <= number <= last for first, last in covered):
+                shutil.rmtree(os.path.join(device_dir, name))
+        elif name.startswith(COMPACT_PREFIX) and name.endswith(COMPACT_EXT):
+            first, last = (int(n) for n in name[len(COMPACT_PREFIX):-len(COMPACT_EXT)].split("_"))
+            if any(a <= first and last <= b and (a, b) != (first, last) for a, b in covered):
+                _remove_segment("compact", os.path.join(device_dir, name))
+
+
+# Datos sin comprimir de un segmento (de un compactado, según su índice)
+def _raw_bytes(kind, path):
+    if kind == "compact":
+        return int(read_compact_index(path)["rows"].sum()) * ROW_BYTES
+    return _segment_bytes(kind, path)
+
+
+# Grupos de segmentos consecutivos (cerrados o ya compactados) de hasta
+# COMPACT_TARGET_BYTES sin comprimir. Con la rotación horaria y una pasada por minuto
+# cada segmento sellado llega solo: así se une al compactado anterior en lugar de quedar
+# un cseg_ por hora. Un compactado que ya no admite más queda fuera de los grupos.
+def _compaction_groups(device_dir, target_bytes):
+    groups, current, current_bytes = [], [], 0
+    for first, last, kind, path in list_segments(device_dir):
+        if kind == "plain" and (path == device_dir or not is_sealed(path)):
+            if current:
+                groups.append(current)
+            current, current_bytes = [], 0
+            continue
+        size = _raw_bytes(kind, path)
+        if current and current_bytes + size > target_bytes:
+            groups.append(current)
+            current, current_bytes = [], 0
+        current.append((first, last, kind, path))
+        current_bytes += size
+    if current:
+        groups.append(current)
+    # Un compactado solo no tiene nada que hacer
+    return [group for group in groups if len(group) > 1 or group[0][2] == "plain"]
+
+
+# Reescribe un grupo de segmentos como un solo fichero comprimido con su índice.
+# Los bloques de los compactados del grupo se copian tal cual (sin recomprimir).
+# Se escribe en temporales, fsync y rename (primero el índice); después se borran los
+# originales. Un corte en cualquier punto deja los datos legibles una sola vez.
+def compact_segments(device_dir, group, throttle=None, backend=None):
+    throttle = throttle or Throttle(0)
+    path = os.path.join(device_dir, compact_name(group[0][0], group[-1][1]))
+    entries = []
+    offset = 0
+    with open(path + ".tmp", "wb") as f:
+        for _, _, kind, segment_dir in group:
+            if kind == "compact":
+                with open(segment_dir, "rb") as src:
+                    for entry in read_compact_index(segment_dir):
+                        src.seek(int(entry["offset"]))
+                        data = src.read(int(entry["size"]))
+                        throttle.consume(2 * len(data))
+                        f.write(data)
+                        entries.append((offset, len(data), *entry.tolist()[2:]))
+                        offset += len(data)
+                continue
+            index = read_index(segment_dir)
+            rows = int(index["row_start"][-1] + index["rows"][-1]) if len(index) else 0
+            mapped = {name: np.memmap(_column_path(segment_dir, name), dtype=dtype, mode="r", shape=(rows,))
+                      for name, dtype in COLUMNS.items()} if rows else {}
+            for start in range(0, rows, BLOCK_ROWS):
+                block = {name: np.array(column[start:start + BLOCK_ROWS]) for name, column in mapped.items()}
+                throttle.consume(sum(values.nbytes for values in block.values()))
+                data = encode_block(block, backend)
+                throttle.consume(len(data))
+                f.write(data)
+                t, seq = block["t"], block["seq"]
+                entries.append((offset, len(data), len(t), t.min(), t.max(), seq.min(), seq.max()))
+                offset += len(data)
+            del mapped
+        f.flush()
+        os.fsync(f.fileno())
+
+    with open(path + ".idx.tmp", "wb") as f:
+        f.write(np.array(entries, dtype=COMPACT_INDEX_DTYPE).tobytes())
+        f.flush()
+        os.fsync(f.fileno())
+
+    os.replace(path + ".idx.tmp", path + ".idx")
+    os.replace(path + ".tmp", path)
+    for _, _, kind, segment_dir in group:
+        _remove_segment(kind, segment_dir)
+    return path
+
+
+def compact_device(device_dir, throttle=None, target_bytes=COMPACT_TARGET_BYTES, backend=None):
+    _cleanup(device_dir)
+    compacted = []
+    for group in _compaction_groups(device_dir, target_bytes):
+        compacted.append(compact_segments(device_dir, group, throttle, backend))
+    return compacted
+
+
+# ------------------------------- RETENCIÓN -------------------------------
+
+# Política de retención sobre todas las sesiones de "root". Solo borra segmentos
+# cerrados (o compactados), empezando siempre por los de datos más antiguos.
+# El total incluye todo lo que hay en las sesiones: además de los segmentos, resúmenes
+# (rollup_*.bin), gaps.csv, losses.csv y el log de captura. Esos ficheros se borran con
+# la sesión cuando la retención elimina su último segmento. La sesión en curso siempre
+# tiene un segmento abierto, así que nunca llega a cero.
+#   max_age: segundos de antigüedad máxima de los datos (None = sin límite)
+#   max_total_bytes: espacio máximo de todas las sesiones (None = sin límite)
+class RetentionPolicy:
+    def __init__(self, max_age=RETENTION_MAX_AGE, max_total_bytes=RETENTION_MAX_BYTES):
+        self.max_age = max_age
+        self.max_total_bytes = max_total_bytes
+
+    def apply(self, root=DATA_RAW_DIR):
+        cutoff = time.time() - self.max_age if self.max_age is not None else None
+        candidates = []
+        sessions = {}  # Carpeta de sesión -> [segmentos que quedan, bytes fuera de los segmentos]
+        total = 0
+        for session_dir in _session_dirs(root):
+            count, segment_bytes = 0, 0
+            for device_dir in _device_dirs(session_dir, all_sessions=False):
+                for _, _, kind, path in list_segments(device_dir):
+                    size = _segment_bytes(kind, path)
+                    count += 1
+                    segment_bytes += size
+                    if kind == "compact" or (path != device_dir and is_sealed(path)):
+                        candidates.append((_segment_t_max(kind, path) or 0, size, kind, path, session_dir))
+            session_bytes, newest = _tree_usage(session_dir)
+            side_bytes = max(session_bytes - segment_bytes, 0)
+            # Restos sin segmentos (p.ej. un corte a mitad de un borrado): se borran al caducar
+            if count == 0 and cutoff is not None and newest < cutoff:
+                shutil.rmtree(session_dir)
+                continue
+            sessions[session_dir] = [count, side_bytes]
+            total += segment_bytes + side_bytes
+
+        removed = 0
+        cutoff_us = cutoff * 1_000_000 if cutoff is not None else None
+        for t_max, size, kind, path, session_dir in sorted(candidates):
+            too_old = cutoff_us is not None and t_max < cutoff_us
+            too_big = self.max_total_bytes is not None and total > self.max_total_bytes
+            if not (too_old or too_big):
+                break
+            _remove_segment(kind, path)
+            total -= size
+            removed += 1
+            session = sessions[session_dir]
+            session[0] -= 1
+            if session[0] == 0:
+                shutil.rmtree(session_dir)
+                total -= session[1]
+
+        _remove_empty_dirs(root)
+        return removed
+
+
+def _remove_segment(kind, path):
+    if kind == "compact":
+        os.remove(path)  # Primero el fichero: sin él el índice se ignora
+        if os.path.exists(path + ".idx"):
+            os.remove(path + ".idx")
+    else:
+        shutil.rmtree(path)
+
+
+def _remove_empty_dirs(root):
+    for device_dir in _device_dirs(root):
+        if not os.listdir(device_dir):
+            os.rmdir(device_dir)
+    for session in os.listdir(root) if os.path.isdir(root) else []:
+        session_dir = os.path.join(root, session)
+        if os.path.isdir(session_dir) and not os.listdir(session_dir):
+            os.rmdir(session_dir)
+
+
+# ------------------------------ HILO DE FONDO ------------------------------
+
+# Ejecuta compactación y retención cada "interval" segundos en un hilo propio.
+# No comparte nada con la recepción: solo toca segmentos ya sellados.
+class StorageMaintainer:
+    def __init__(self, root=DATA_RAW_DIR, retention=None, throttle_rate=THROTTLE_BYTES_PER_SEC,
+                 interval=MAINTENANCE_INTERVAL, compact=True):
+        self.root = root
+        self.retention = retention
+        self.throttle = Throttle(throttle_rate)
+        self.interval = interval
+        self.compact = compact
+        self.compacted = 0
+        self.removed = 0
+        self._stop = threading.Event()
+        self._thread = threading.Thread(target=self._run, name="tfm-storage", daemon=True)
+
+    def start(self):
+        self._thread.start()
+
+    def run_once(self):
+        if self.compact:
+            for device_dir in _device_dirs(self.root):
+                if self._stop.is_set():
+                    return
+                self.compacted += len(compact_device(device_dir, self.throttle))
+        if self.retention is not None:
+            self.removed += self.retention.apply(self.root)
+
+    def _run(self):
+        while not self._stop.wait(self.interval):
+            try:
+                self.run_once()
+            except OSError as e:
+                print(f"[Almacenamiento] Error en el mantenimiento: {e}")
+
+    def stop(self):
+        self._stop.set()
+        self._thread.join()
+        print(f"[Almacenamiento] Segmentos compactados {self.compacted}, borrados por retención {self.removed}")
+
+
+# Mantenimiento manual (compactar todo y aplicar retención):
+#   python -m modules.storage_maintenance [días_máximos] [GB_máximos]
+if __name__ == "__main__":
+    import sys
+
+    days = float(sys.argv[1]) if len(sys.argv) > 1 else RETENTION_MAX_AGE / 86400
+    gigabytes = float(sys.argv[2]) if len(sys.argv) > 2 else RETENTION_MAX_BYTES / 1024**3
+    maintainer = StorageMaintainer(retention=RetentionPolicy(days * 86400, int(gigabytes * 1024**3)),
+                                   throttle_rate=0)
+    maintainer.run_once()
+    print(f"Compactados {maintainer.compacted} segmentos, borrados {maintainer.removed}")
@@ -0,0 +1,182 @@
+import asyncio
+import time
+
+import numpy as np
+
+from modules.data_handler import DeviceClock
+
+# Trazado de latencia por paquete: cuánto tarda una muestra en llegar al almacén y en qué
+# tramo se pierde el tiempo. Marcas de cada paquete:
+#   adquisición  última muestra del paquete (reloj del dispositivo: timestamp_start + n/frecuencia)
+#   envío        entrega a NimBLE (reloj del dispositivo: timestamp_start + notify_offset_ms, v2)
+#   recepción    callback de notificación en la Raspi (t_recv)
+#   decodificado fin de la etapa "decode" del pipeline
+#   almacenado   fin de la etapa "store" (los sinks han recibido el paquete; BackgroundSink
+#                solo lo ha encolado para su hilo). Incluye la etapa "sequence": tras un
+#                paquete perdido los siguientes esperan ahí hasta darlo por perdido.
+# No hay reloj común con el dispositivo: el tramo envío -> recepción se mide con el mismo
+# filtro de retardo mínimo que DeviceClock, así que es relativo al paquete más rápido
+# (radio + BlueZ por encima del mejor caso). Los demás tramos son absolutos.
+
+# Límites superiores de las cubetas (ms): 6 por década de 0,1 ms a 70 s (+ desbordamiento)
+BUCKET_BOUNDS_MS = tuple(round(m * 10.0 ** e, 6) for e in range(-1, 5) for m in (1, 1.5, 2, 3, 5, 7))
+LAG_PROBE_SECONDS = 0.01
+
+# Tramos: clave -> etiqueta para los informes
+SEGMENTS = {
+    "holdback": "retención (dispositivo)",
+    "link": "enlace (radio + BlueZ)*",
+    "decode": "decodificación (Python)",
+    "store": "almacenamiento (Python)",
+    "age": "edad al almacenar",
+}
+
+
+# Histograma de latencias con cubetas logarítmicas fijas: memoria constante y
+# percentiles aproximados (interpolando dentro de la cubeta, nunca más que el máximo)
+class LatencyHistogram:
+    def __init__(self):
+        self.buckets = [0] * (len(BUCKET_BOUNDS_MS) + 1)
+        self.count = 0
+        self.total = 0.0
+        self.max = 0.0
+
+    def add(self, value_ms):
+        value_ms = max(value_ms, 0.0)
+        index = 0
+        while index < len(BUCKET_BOUNDS_MS) and value_ms > BUCKET_BOUNDS_MS[index]:
+            index += 1
+        self.buckets[index] += 1
+        self.count += 1
+        self.total += value_ms
+        if value_ms > self.max:
+            self.max = value_ms
+
+    def percentile(self, p):
+        if self.count == 0:
+            return 0.0
+        target = p / 100 * self.count
+        seen = 0
+        for index, count in enumerate(self.buckets):
+            if count and seen + count >= target:
+                if index == len(BUCKET_BOUNDS_MS):
+                    return self.max
+                lower = BUCKET_BOUNDS_MS[index - 1] if index else 0.0
+                upper = min(BUCKET_BOUNDS_MS[index], self.max)
+                return lower + (upper - lower) * (target - seen) / count
+            seen += count
+        return self.max
+
+    def as_dict(self):
+        return {
+            "count": self.count,
+            "mean_ms": self.total / self.count if self.count else 0.0,
+            "p50_ms": self.percentile(50),
+            "p95_ms": self.percentile(95),
+            "p99_ms": self.percentile(99),
+            "max_ms": self.max,
+            # Cubetas acumulables (p.ej. para Prometheus): [(límite_ms, recuento), ...]
+            "buckets": list(zip(BUCKET_BOUNDS_MS + (float("inf"),), self.buckets)),
+        }
+
+
+# Retraso del bucle asyncio: cuánto se pasa de hora un sleep corto. Si crece, Python
+# (callbacks, decodificación, sinks) no da abasto y todo lo demás espera.
+class LoopLagProbe:
+    def __init__(self, interval=LAG_PROBE_SECONDS):
+        self.interval = interval
+        self.histogram = LatencyHistogram()
+        self._task = None
+
+    async def _run(self):
+        loop = asyncio.get_running_loop()
+        while True:
+            start = loop.time()
+            await asyncio.sleep(self.interval)
+            self.histogram.add((loop.time() - start - self.interval) * 1000)
+
+    def start(self):
+        if self._task is None:
+            self._task = asyncio.get_running_loop().create_task(self._run())
+
+    def stop(self):
+        if self._task is not None:
+            self._task.cancel()
+            self._task = None
+
+
+class PacketTracer:
+    def __init__(self):
+        self.segments = {key: LatencyHistogram() for key in SEGMENTS}
+        self.devices = {}  # alias -> {tramo: LatencyHistogram}
+        self.clocks = {}   # alias -> DeviceClock (reloj del dispositivo -> Raspi)
+        self.loop_lag = LoopLagProbe()
+
+    # Etapa "decode": marca el fin de la decodificación en el propio paquete
+    def mark_decoded(self, packet):
+        packet["t_decoded_ns"] = time.monotonic_ns()
+
+    # Etapa "store": con el paquete ya entregado a los sinks, calcula todos sus tramos
+    def record(self, alias, t_recv, packet):
+        t_stored = time.monotonic_ns()
+        t_decoded = packet.get("t_decoded_ns", t_recv)
+        clock = self.clocks.get(alias)
+        if clock is None:
+            clock = self.clocks[alias] = DeviceClock()
+
+        # Marcas del dispositivo (µs): primera muestra, última muestra y, si la hay, envío
+        first_us = packet["timestamp_start"] * 1000
+        acquired_us = first_us + (len(packet["x"]) - 1) * 1_000_000 // packet["sample_rate"]
+        device_us = [first_us, acquired_us]
+        if packet.get("notify_offset_ms") is not None:
+            device_us.append(first_us + packet["notify_offset_ms"] * 1000)
+        # El offset se ajusta con la última marca: el envío (v2) o la adquisición (v1, el
+        # enlace incluye entonces la retención)
+        host_us = clock.to_host_us(np.array(device_us, dtype=np.int64), t_recv)
+
+        recv_us = DeviceClock.wall_us(t_recv)
+        values = {
+            "link": (recv_us - int(host_us[-1])) / 1000,
+            "decode": (t_decoded - t_recv) / 1e6,
+            "store": (t_stored - t_decoded) / 1e6,
+            "age": (DeviceClock.wall_us(t_stored) - int(host_us[0])) / 1000,
+        }
+        if len(device_us) == 3:
+            values["holdback"] = (device_us[2] - acquired_us) / 1000
+
+        device = self.devices.get(alias)
+        if device is None:
+            device = self.devices[alias] = {key: LatencyHistogram() for key in SEGMENTS}
+        for key, value in values.items():
+            self.segments[key].add(value)
+            device[key].add(value)
+
+    def start(self):
+        self.loop_lag.start()
+
+    def stop(self):
+        self.loop_lag.stop()
+
+    def as_dict(self):
+        return {
+            "segments": {key: hist.as_dict() for key, hist in self.segments.items()},
+            "devices": {alias: {key: hist.as_dict() for key, hist in segments.items()}
+                        for alias, segments in self.devices.items()},
+            "loop_lag": self.loop_lag.histogram.as_dict(),
+        }
+
+    def print_report(self):
+        print("Latencias por tramo (ms):")
+        print(f" {'tramo':<28} {'paquetes':>9} {'p50':>8} {'p95':>8} {'p99':>8} {'máx':>8}")
+        rows = [(SEGMENTS[key], hist) for key, hist in self.segments.items()]
+        rows.append(("retraso del bucle asyncio", self.loop_lag.histogram))
+        for label, hist in rows:
+            if hist.count:
+                print(f" {label:<28} {hist.count:>9} {hist.percentile(50):>8.1f} {hist.percentile(95):>8.1f} "
+                      f"{hist.percentile(99):>8.1f} {hist.max:>8.1f}")
+        print(" * Relativo al paquete más rápido (sin reloj común con el dispositivo).")
+        if self.devices:
+            print(" p95 por dispositivo: " + ", ".join(SEGMENTS[key].split(" (")[0] for key in SEGMENTS))
+            for alias, segments in sorted(self.devices.items()):
+                print(f"  [{alias}] " + " / ".join(f"{hist.percentile(95):.1f}" if hist.count else "-"
+                                                  for hist in segments.values()))
@@ -0,0 +1,43 @@
+import asyncio
+import subprocess  # Necesario para borrar claves de sistema en Linux
+
+# Capa de transporte bajo BLEManager y BackgroundScanner: de dónde salen los clientes y
+# los escáneres. BleakTransport usa el Bluetooth real (BlueZ); SimulatedTransport
+# (modules/simulator.py) crea dispositivos virtuales dentro del proceso.
+#
+# Un transporte expone:
+#   client(device_o_mac, disconnected_callback) -> cliente con la interfaz de BleakClient
+#       que usa BLEManager: address, is_connected, services.get_characteristic(uuid),
+#       connect(), disconnect(), start_notify(uuid, cb), stop_notify(uuid),
+#       write_gatt_char(uuid, data, response)
+#   scanner(detection_callback, service_uuids) -> start()/stop() como BleakScanner
+#   find_device(mac, timeout) -> dispositivo o None (escaneo puntual)
+#   remove_bond(mac) -> borra las claves de emparejamiento guardadas
+
+
+class BleakTransport:
+    name = "bleak"
+
+    def __init__(self):
+        # Import diferido: el simulador funciona sin bleak ni BlueZ
+        from bleak import BleakClient, BleakScanner
+        self._client_class = BleakClient
+        self._scanner_class = BleakScanner
+
+    def client(self, device, disconnected_callback):
+        return self._client_class(device, disconnected_callback=disconnected_callback)
+
+    def scanner(self, detection_callback, service_uuids):
+        return self._scanner_class(detection_callback=detection_callback, service_uuids=service_uuids)
+
+    async def find_device(self, address, timeout):
+        return await self._scanner_class.find_device_by_address(address, timeout=timeout)
+
+    # Borra las claves de BlueZ sin bloquear el bucle asyncio
+    async def remove_bond(self, mac):
+        try:
+            process = await asyncio.create_subprocess_exec(
+                "bluetoothctl", "remove", mac, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+            await asyncio.wait_for(process.wait(), timeout=5)
+        except (OSError, asyncio.TimeoutError) as e:
+            print(f"Error borrando claves de sistema: {e}")
@@ -0,0 +1,444 @@
+"""Generador del formato de paquete BLE a partir de accel_packet.json.
+
+El esquema es la única fuente de verdad del formato. A partir de él se generan:
+  - TFM_BLE_Dispositivo/main/include/accel_packet.h  (structs C empaquetados + _Static_assert)
+  - TFM_Raspi/modules/packet_schema.py               (dtypes estructurados de NumPy)
+
+Uso:
+  python protocol/gen_packet.py            # Regenera ambos ficheros
+  python protocol/gen_packet.py --check    # Falla si están desactualizados y prueba la ida y
+                                           # vuelta C <-> Python (v2, v1 y v0) con el compilador local
+"""
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+SCHEMA_PATH = os.path.join(ROOT, "protocol", "accel_packet.json")
+C_OUT = os.path.join(ROOT, "TFM_BLE_Dispositivo", "main", "include", "accel_packet.h")
+PY_OUT = os.path.join(ROOT, "TFM_Raspi", "modules", "packet_schema.py")
+
+# Tipo del esquema -> (tipo C, código NumPy sin endianness, tamaño)
+PRIMITIVES = {
+    "uint8": ("uint8_t", "u1", 1),
+    "int8": ("int8_t", "i1", 1),
+    "uint16": ("uint16_t", "u2", 2),
+    "int16": ("int16_t", "i2", 2),
+    "uint32": ("uint32_t", "u4", 4),
+    "int32": ("int32_t", "i4", 4),
+    "uint64": ("uint64_t", "u8", 8),
+    "int64": ("int64_t", "i8", 8),
+}
+
+BANNER = "GENERADO AUTOMATICAMENTE por protocol/gen_packet.py a partir de protocol/accel_packet.json. NO EDITAR."
+
+
+def load_schema(path=SCHEMA_PATH):
+    with open(path, encoding="utf-8") as f:
+        return json.load(f)
+
+
+# Resuelve el número de elementos de un array (literal o nombre de constante)
+def _count(schema, field):
+    count = field.get("count", 1)
+    if isinstance(count, str):
+        for const in schema["constants"]:
+            if const["name"] == count:
+                return const["value"]
+        raise ValueError(f"Constante desconocida en el esquema: {count}")
+    return count
+
+
+# Tamaño en bytes de cada struct (empaquetado, sin relleno)
+def struct_sizes(schema):
+    sizes = {}
+    for struct in schema["structs"]:
+        size = 0
+        for field in struct["fields"]:
+            if field["type"] in PRIMITIVES:
+                item = PRIMITIVES[field["type"]][2]
+            else:
+                item = sizes[field["type"]] # Los structs se definen antes de usarse
+            size += item * _count(schema, field)
+        if "size" in struct and struct["size"] != size:
+            raise ValueError(f"{struct['name']}: el esquema declara {struct['size']} bytes pero suma {size}")
+        sizes[struct["name"]] = size
+    return sizes
+
+
+# ------------------------------- C ---------------------------------------
+
+def generate_c(schema):
+    prefix = schema["prefix"]
+    sizes = struct_sizes(schema)
+    out = [
+        f"/* {BANNER} */",
+        "#ifndef ACCEL_PACKET_H",
+        "#define ACCEL_PACKET_H",
+        "",
+        "#include <stdint.h>",
+        "",
+    ]
+
+    for const in schema["constants"]:
+        line = f"#define {prefix}_{const['name']} {const['value']}"
+        if "doc" in const:
+            line += f" /* {const['doc']} */"
+        out.append(line)
+    out.append("")
+
+    for struct in schema["structs"]:
+        # Macros de campos de bits (desplazamiento, máscara y empaquetado)
+        for field in struct["fields"]:
+            if "bits" not in field:
+                continue
+            name = field["name"].upper()
+            args = ", ".join(b["name"] for b in field["bits"])
+            parts = []
+            for b in field["bits"]:
+                mask = (1 << b["width"]) - 1
+                out.append(f"#define {prefix}_{name}_{b['name'].upper()}_SHIFT {b['shift']}")
+                out.append(f"#define {prefix}_{name}_{b['name'].upper()}_MASK 0x{mask:02X}")
+                parts.append(f"((({b['name']}) & 0x{mask:02X}) << {b['shift']})")
+            c_type = PRIMITIVES[field["type"]][0]
+            out.append(f"#define {prefix}_PACK_{name}({args}) (({c_type})({' | '.join(parts)}))")
+            out.append("")
+
+        out.append(f"/* {struct['doc']} */")
+        out.append("typedef struct __attribute__((packed)) {")
+        for field in struct["fields"]:
+            c_type = PRIMITIVES[field["type"]][0] if field["type"] in PRIMITIVES else field["type"]
+            decl = f"    {c_type} {field['name']}"
+            if "count" in field:
+                count = field["count"]
+                decl += f"[{prefix}_{count}]" if isinstance(count, str) else f"[{count}]"
+            decl += ";"
+            if "doc" in field:
+                decl += f" /* {field['doc']} */"
+            out.append(decl)
+        out.append(f"}} {struct['name']};")
+        out.append(f"_Static_assert(sizeof({struct['name']}) == {sizes[struct['name']]}, "
+                   f"\"{struct['name']} no coincide con el esquema\");")
+        out.append("")
+
+    out.append("#endif // ACCEL_PACKET_H")
+    out.append("")
+    return "\n".join(out)
+
+
+# ----------------------------- Python ------------------------------------
+
+def _np_fields(schema, struct, endian):
+    fields = []
+    for field in struct["fields"]:
+        if field["type"] in PRIMITIVES:
+            dtype = repr(endian + PRIMITIVES[field["type"]][1])
+        else:
+            dtype = _dtype_name(schema, field["type"])
+        if "count" in field:
+            count = field["count"]
+            count = count if isinstance(count, str) else str(count)
+            fields.append(f"(\"{field['name']}\", {dtype}, ({count},))")
+        else:
+            fields.append(f"(\"{field['name']}\", {dtype})")
+    return fields
+
+
+def _dtype_name(schema, struct_name):
+    for struct in schema["structs"]:
+        if struct["name"] == struct_name:
+            return struct["dtype"]
+    raise ValueError(f"Struct desconocido: {struct_name}")
+
+
+def generate_py(schema):
+    endian = "<" if schema["endianness"] == "little" else ">"
+    sizes = struct_sizes(schema)
+    out = [
+        f"# {BANNER}",
+        "import numpy as np",
+        "",
+    ]
+
+    for const in schema["constants"]:
+        line = f"{const['name']} = {const['value']}"
+        if "doc" in const:
+            line += f"  # {const['doc']}"
+        out.append(line)
+    out.append("")
+
+    # Campos de bits: {campo: {subcampo: (desplazamiento, máscara)}}
+    out.append("# Campos de bits: {campo: {subcampo: (desplazamiento, máscara)}}")
+    out.append("BITFIELDS = {")
+    for struct in schema["structs"]:
+        for field in struct["fields"]:
+            if "bits" in field:
+                bits = ", ".join(f"\"{b['name']}\": ({b['shift']}, 0x{(1 << b['width']) - 1:02X})"
+                                 for b in field["bits"])
+                out.append(f"    \"{field['name']}\": {{{bits}}},")
+    out.append("}")
+    out.append("")
+
+    for struct in schema["structs"]:
+        name = _dtype_name(schema, struct["name"])
+        out.append(f"# {struct['doc']}")
+        out.append(f"{name} = np.dtype([")
+        for field in _np_fields(schema, struct, endian):
+            out.append(f"    {field},")
+        out.append("])")
+        out.append(f"assert {name}.itemsize == {sizes[struct['name']]}")
+        out.append("")
+
+    return "\n".join(out)
+
+
+# ----------------------------- Comprobación -------------------------------
+
+# Valores de prueba comunes a los dos lados (una muestra i = (i*100 - 1700, -i, i*900))
+TEST_SEQUENCE_ID = 0xA1B2C3D4
+TEST_TIMESTAMP = 123456
+TEST_NOTIFY_OFFSET = 4321
+LEGACY_VERSION = 1  # Versión de la cabecera sin notify_offset_ms
+
+# Programa C con el header generado:
+#   roundtrip emit   vuelca en binario un paquete v2, uno v1 y uno v0 (en ese orden)
+#   roundtrip check  lee los mismos tres paquetes de stdin y comprueba campo a campo
+_ROUNDTRIP_C = r"""
+#include <stdio.h>
+#include <string.h>
+#include "accel_packet.h"
+
+#define SEQ 0xA1B2C3D4u
+#define TS 123456u
+#define OFFSET 4321u
+
+/* La versión 1 solo define la cabecera: el paquete se compone aquí */
+typedef struct __attribute__((packed)) {
+    accel_header_v1_t header;
+    accel_raw_t samples[ACCEL_SAMPLES_PER_PACKET];
+} packet_v1_t;
+
+static int errors = 0;
+#define CHECK(cond) do { if (!(cond)) { fprintf(stderr, "FALLO: %s\n", #cond); errors++; } } while (0)
+
+static void fill_samples(accel_raw_t *s, int n) {
+    int i;
+    for (i = 0; i < n; i++) {
+        s[i].x = (int16_t)(i * 100 - 1700);
+        s[i].y = (int16_t)(-i);
+        s[i].z = (int16_t)(i * 900);
+    }
+}
+
+static void check_samples(const accel_raw_t *s, int n) {
+    int i;
+    for (i = 0; i < n; i++) {
+        CHECK(s[i].x == (int16_t)(i * 100 - 1700));
+        CHECK(s[i].y == (int16_t)(-i));
+        CHECK(s[i].z == (int16_t)(i * 900));
+    }
+}
+
+int main(int argc, char **argv) {
+    accel_packet_t v2 = {0};
+    packet_v1_t v1 = {0};
+    accel_packet_v0_t v0 = {0};
+
+    if (argc > 1 && strcmp(argv[1], "check") == 0) {
+        if (fread(&v2, sizeof(v2), 1, stdin) != 1 || fread(&v1, sizeof(v1), 1, stdin) != 1
+                || fread(&v0, sizeof(v0), 1, stdin) != 1) {
+            fprintf(stderr, "FALLO: faltan bytes en la entrada\n");
+            return 1;
+        }
+        CHECK(v2.header.format == ACCEL_PACK_FORMAT(ACCEL_ENC_RAW_I16, ACCEL_FORMAT_VERSION));
+        CHECK(v2.header.channels == ACCEL_PACK_CHANNELS(ACCEL_CH_XYZ, ACCEL_RANGE_8G));
+        CHECK(v2.header.sample_rate_hz == 100);
+        CHECK(v2.header.sample_count == ACCEL_SAMPLES_PER_PACKET);
+        CHECK(v2.header.sequence_id == SEQ);
+        CHECK(v2.header.timestamp_start == TS);
+        CHECK(v2.header.notify_offset_ms == OFFSET);
+        check_samples(v2.samples, ACCEL_SAMPLES_PER_PACKET);
+
+        CHECK(v1.header.format == ACCEL_PACK_FORMAT(ACCEL_ENC_RAW_I16, 1));
+        CHECK(v1.header.channels == ACCEL_PACK_CHANNELS(ACCEL_CH_XYZ, ACCEL_RANGE_4G));
+        CHECK(v1.header.sample_rate_hz == 50);
+        CHECK(v1.header.sample_count == ACCEL_SAMPLES_PER_PACKET);
+        CHECK(v1.header.sequence_id == SEQ);
+        CHECK(v1.header.timestamp_start == TS);
+        check_samples(v1.samples, ACCEL_SAMPLES_PER_PACKET);
+
+        CHECK(v0.sequence_id == SEQ);
+        CHECK(v0.timestamp_start == TS);
+        check_samples(v0.samples, 35);
+        return errors ? 1 : 0;
+    }
+
+    v2.header.format = ACCEL_PACK_FORMAT(ACCEL_ENC_RAW_I16, ACCEL_FORMAT_VERSION);
+    v2.header.channels = ACCEL_PACK_CHANNELS(ACCEL_CH_XYZ, ACCEL_RANGE_8G);
+    v2.header.sample_rate_hz = 100;
+    v2.header.sample_count = ACCEL_SAMPLES_PER_PACKET;
+    v2.header.sequence_id = SEQ;
+    v2.header.timestamp_start = TS;
+    v2.header.notify_offset_ms = OFFSET;
+    fill_samples(v2.samples, ACCEL_SAMPLES_PER_PACKET);
+
+    v1.header.format = ACCEL_PACK_FORMAT(ACCEL_ENC_RAW_I16, 1);
+    v1.header.channels = ACCEL_PACK_CHANNELS(ACCEL_CH_XYZ, ACCEL_RANGE_4G);
+    v1.header.sample_rate_hz = 50;
+    v1.header.sample_count = ACCEL_SAMPLES_PER_PACKET;
+    v1.header.sequence_id = SEQ;
+    v1.header.timestamp_start = TS;
+    fill_samples(v1.samples, ACCEL_SAMPLES_PER_PACKET);
+
+    v0.sequence_id = SEQ;
+    v0.timestamp_start = TS;
+    fill_samples(v0.samples, 35);
+
+    fwrite(&v2, sizeof(v2), 1, stdout);
+    fwrite(&v1, sizeof(v1), 1, stdout);
+    fwrite(&v0, sizeof(v0), 1, stdout);
+    return 0;
+}
+"""
+
+
+def schema_version():
+    return next(c["value"] for c in load_schema()["constants"] if c["name"] == "FORMAT_VERSION")
+
+
+def _pack(value, field, **parts):
+    from modules.packet_schema import BITFIELDS
+    for name, (shift, mask) in BITFIELDS[field].items():
+        value |= (parts[name] & mask) << shift
+    return value
+
+
+# Los tres paquetes de prueba construidos solo con los dtypes generados (v2, v1, v0)
+def _python_packets():
+    import numpy as np
+    from modules import packet_schema as ps
+
+    n = ps.SAMPLES_PER_PACKET
+    samples = np.zeros(n, dtype=ps.SAMPLE_DTYPE)
+    samples["x"] = np.arange(n) * 100 - 1700
+    samples["y"] = -np.arange(n)
+    samples["z"] = np.arange(n) * 900
+
+    v2 = np.zeros(1, dtype=ps.PACKET_DTYPE)
+    header = v2["header"]
+    header["format"] = _pack(0, "format", encoding=ps.ENC_RAW_I16, version=ps.FORMAT_VERSION)
+    header["channels"] = _pack(0, "channels", mask=ps.CH_XYZ, range=ps.RANGE_8G)
+    header["sample_rate_hz"] = 100
+    header["sample_count"] = n
+    header["sequence_id"] = TEST_SEQUENCE_ID
+    header["timestamp_start"] = TEST_TIMESTAMP
+    header["notify_offset_ms"] = TEST_NOTIFY_OFFSET
+    v2["header"] = header
+    v2["samples"][0] = samples
+
+    v1 = np.zeros(1, dtype=[("header", ps.HEADER_V1_DTYPE), ("samples", ps.SAMPLE_DTYPE, (n,))])
+    header = v1["header"]
+    header["format"] = _pack(0, "format", encoding=ps.ENC_RAW_I16, version=LEGACY_VERSION)
+    header["channels"] = _pack(0, "channels", mask=ps.CH_XYZ, range=ps.RANGE_4G)
+    header["sample_rate_hz"] = 50
+    header["sample_count"] = n
+    header["sequence_id"] = TEST_SEQUENCE_ID
+    header["timestamp_start"] = TEST_TIMESTAMP
+    v1["header"] = header
+    v1["samples"][0] = samples
+
+    v0 = np.zeros(1, dtype=ps.LEGACY_PACKET_DTYPE)
+    v0["sequence_id"] = TEST_SEQUENCE_ID
+    v0["timestamp_start"] = TEST_TIMESTAMP
+    v0["samples"][0] = samples[:35]
+
+    return [v2.tobytes(), v1.tobytes(), v0.tobytes()]
+
+
+# Comprueba un paquete decodificado por data_handler contra los valores de prueba
+def _decoded_ok(packet, version, rate, range_g, notify_offset):
+    return (packet is not None
+            and packet["version"] == version and packet["sample_rate"] == rate and packet["range_g"] == range_g
+            and packet["sequence_id"] == TEST_SEQUENCE_ID and packet["timestamp_start"] == TEST_TIMESTAMP
+            and packet.get("notify_offset_ms") == notify_offset
+            and len(packet["samples"]) == 35
+            and all(s == {"x": i * 100 - 1700, "y": -i, "z": i * 900} for i, s in enumerate(packet["samples"])))
+
+
+def roundtrip_check():
+    cc = shutil.which("cc") or shutil.which("gcc")
+    if cc is None:
+        print("Sin compilador C: se omite la prueba de ida y vuelta.")
+        return True
+
+    sys.path.insert(0, os.path.join(ROOT, "TFM_Raspi"))
+    import numpy as np
+    from modules.data_handler import LEGACY_SAMPLE_RATE, decode_packet, decode_packets
+
+    python_packets = _python_packets()
+    with tempfile.TemporaryDirectory() as tmp:
+        src = os.path.join(tmp, "roundtrip.c")
+        exe = os.path.join(tmp, "roundtrip")
+        with open(src, "w") as f:
+            f.write(_ROUNDTRIP_C)
+        subprocess.run([cc, "-std=c11", "-Wall", "-I", os.path.dirname(C_OUT), src, "-o", exe], check=True)
+        data = subprocess.run([exe, "emit"], check=True, capture_output=True).stdout
+        # Python -> C: los bytes de los dtypes los interpreta el propio struct C
+        check = subprocess.run([exe, "check"], input=b"".join(python_packets), capture_output=True)
+
+    # C -> Python: decodificador por paquete y vectorizado, con las tres versiones
+    sizes = [len(p) for p in python_packets]
+    c_packets = [data[sum(sizes[:k]):sum(sizes[:k + 1])] for k in range(len(sizes))]
+    expected = [(schema_version(), 100, 8, TEST_NOTIFY_OFFSET), (LEGACY_VERSION, 50, 4, None),
+                (0, LEGACY_SAMPLE_RATE, None, None)]
+    c_to_py = len(data) == sum(sizes) and all(
+        _decoded_ok(decode_packet(packet), *args) for packet, args in zip(c_packets, expected))
+    batch = decode_packets(c_packets)
+    c_to_py = c_to_py and bool(batch["valid"].all()) and all(
+        np.array_equal(batch[axis].reshape(len(c_packets), 35), np.tile(values, (len(c_packets), 1)))
+        for axis, values in (("x", np.arange(35) * 100 - 1700), ("y", -np.arange(35)), ("z", np.arange(35) * 900)))
+    print("Ida y vuelta C -> Python (v2, v1, v0):", "OK" if c_to_py else "FALLO")
+
+    py_to_c = check.returncode == 0
+    print("Ida y vuelta Python -> C (v2, v1, v0):", "OK" if py_to_c else "FALLO")
+    if not py_to_c:
+        print(check.stderr.decode(errors="replace"), end="")
+
+    # Los dos lados deben producir exactamente los mismos bytes
+    identical = c_packets == python_packets
+    if not identical:
+        print("FALLO: los bytes generados en C y en Python no coinciden")
+    return c_to_py and py_to_c and identical
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--check", action="store_true", help="Comprobar sin escribir")
+    args = parser.parse_args()
+
+    schema = load_schema()
+    outputs = {C_OUT: generate_c(schema), PY_OUT: generate_py(schema)}
+
+    if not args.check:
+        for path, content in outputs.items():
+            with open(path, "w", encoding="utf-8") as f:
+                f.write(content)
+            print(f"Generado {os.path.relpath(path, ROOT)}")
+        return 0
+
+    ok = True
+    for path, content in outputs.items():
+        current = open(path, encoding="utf-8").read() if os.path.exists(path) else None
+        if current != content:
+            print(f"DESACTUALIZADO: {os.path.relpath(path, ROOT)} (ejecute protocol/gen_packet.py)")
+            ok = False
+    ok = roundtrip_check() and ok
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())